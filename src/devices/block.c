@@ -3,6 +3,8 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 
 /* A block device. */
@@ -19,6 +21,13 @@ struct block
 
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Requests submitted with block_submit(). */
+    unsigned long long request_cnt;     /* Number completed. */
+    unsigned in_flight;                 /* Number submitted, not done. */
+    unsigned max_in_flight;             /* Peak of in_flight. */
+    unsigned long long depth_sum;       /* Sum of in_flight at submit. */
+    int64_t wait_ticks;                 /* Sum of time queued in driver. */
   };
 
 /* List of all block devices. */
@@ -113,6 +122,30 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Transfers CNT sectors starting at SECTOR between BLOCK and
+   BUFFER through BLOCK's request queue, reading unless WRITE is
+   true, and waits for completion. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffer, bool write)
+{
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      struct block_request r;
+      size_t chunk = cnt < BLOCK_REQUEST_MAX ? cnt : BLOCK_REQUEST_MAX;
+
+      block_request_init (&r, sector, chunk, p, write);
+      block_submit (block, &r);
+      block_wait (&r);
+
+      p += chunk * BLOCK_SECTOR_SIZE;
+      sector += chunk;
+      cnt -= chunk;
+    }
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +153,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +164,170 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Drivers that support it do this with a single command, which
+   saves the per-command overhead of CNT block_read() calls.
+   Waits for the data to arrive; see block_submit() for a way not
+   to. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  uint8_t *p = buffer;
+  size_t i;
+
+  if (cnt == 0)
+    return;
   check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
+  if (block->ops->submit != NULL)
+    transfer (block, sector, cnt, buffer, false);
+  else
+    {
+      if (block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->read (block->aux, sector + i,
+                            p + i * BLOCK_SECTOR_SIZE);
+      block->read_cnt += cnt;
+    }
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.  Like block_read_multiple(), uses a single command
+   where the driver supports it. */
+void
+block_write_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                      const void *buffer)
+{
+  const uint8_t *p = buffer;
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  check_sector (block, sector);
+  check_sector (block, sector + cnt - 1);
   ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  if (block->ops->submit != NULL)
+    transfer (block, sector, cnt, (void *) buffer, true);
+  else
+    {
+      if (block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, sector, cnt, buffer);
+      else
+        for (i = 0; i < cnt; i++)
+          block->ops->write (block->aux, sector + i,
+                             p + i * BLOCK_SECTOR_SIZE);
+      block->write_cnt += cnt;
+    }
+}
+
+/* Initializes R as a request to transfer CNT sectors, at most
+   BLOCK_REQUEST_MAX, starting at SECTOR between a block device
+   and BUFFER, reading from the device unless WRITE is true. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool write)
+{
+  ASSERT (cnt >= 1 && cnt <= BLOCK_REQUEST_MAX);
+
+  r->block = NULL;
+  r->dev = NULL;
+  r->sector = sector;
+  r->count = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->submit_time = r->start_time = 0;
+  sema_init (&r->done, 0);
+}
+
+/* Starts request R on BLOCK and returns without waiting for it to
+   complete; use block_wait() for that.  R and its buffer must stay
+   valid until then.  Requests to devices on different channels
+   proceed in parallel.
+
+   A driver stacked on another block device, e.g. a partition,
+   may adjust R's sector and pass it down with this function.  R
+   is then accounted in the queue statistics of the device it was
+   first submitted to. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+
+  check_sector (block, r->sector);
+  check_sector (block, r->sector + r->count - 1);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+
+  old_level = intr_disable ();
+  if (r->block == NULL)
+    {
+      r->block = block;
+      r->submit_time = r->start_time = timer_ticks ();
+      block->in_flight++;
+      if (block->in_flight > block->max_in_flight)
+        block->max_in_flight = block->in_flight;
+      block->depth_sum += block->in_flight;
+    }
+  if (r->write)
+    block->write_cnt += r->count;
+  else
+    block->read_cnt += r->count;
+  intr_set_level (old_level);
+
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else
+    {
+      /* Synchronous driver: do the transfer now. */
+      uint8_t *p = r->buffer;
+      size_t i;
+
+      if (r->write && block->ops->write_multiple != NULL)
+        block->ops->write_multiple (block->aux, r->sector, r->count, p);
+      else if (!r->write && block->ops->read_multiple != NULL)
+        block->ops->read_multiple (block->aux, r->sector, r->count, p);
+      else
+        for (i = 0; i < r->count; i++, p += BLOCK_SECTOR_SIZE)
+          if (r->write)
+            block->ops->write (block->aux, r->sector + i, p);
+          else
+            block->ops->read (block->aux, r->sector + i, p);
+      block_request_done (r);
+    }
+}
+
+/* Waits for request R, previously passed to block_submit(), to
+   complete. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Called by a driver when it has finished transferring request R.
+   The driver should set R's start_time when it issues R to the
+   hardware, so that queueing delay can be told apart. */
+void
+block_request_done (struct block_request *r)
+{
+  struct block *block = r->block;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  block->in_flight--;
+  block->request_cnt++;
+  block->wait_ticks += r->start_time - r->submit_time;
+  intr_set_level (old_level);
+
+  sema_up (&r->done);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -174,6 +365,14 @@ block_print_stats (void)
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
                   block->read_cnt, block->write_cnt);
+          if (block->request_cnt > 0)
+            printf ("%s (%s): %llu requests, %llu.%02llu in flight on "
+                    "average, %u at most, %"PRId64" ticks queued\n",
+                    block->name, block_type_name (block->type),
+                    block->request_cnt,
+                    block->depth_sum / block->request_cnt,
+                    block->depth_sum * 100 / block->request_cnt % 100,
+                    block->max_in_flight, block->wait_ticks);
         }
     }
 }
@@ -200,6 +399,10 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
+  block->in_flight = block->max_in_flight = 0;
+  block->depth_sum = 0;
+  block->wait_ticks = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
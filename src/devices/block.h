@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,9 +56,19 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+struct block_request;
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, void *buffer, bool write);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
 
@@ -65,8 +78,43 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Transfer CNT consecutive sectors in one request.  Optional:
+       if null, the block layer issues CNT single-sector
+       requests instead. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Start request R and return without waiting for it, calling
+       block_request_done() once it has completed.  Optional: if
+       non-null, every transfer goes through it and the functions
+       above may be null. */
+    void (*submit) (void *aux, struct block_request *r);
+  };
+
+/* Most sectors in one struct block_request. */
+#define BLOCK_REQUEST_MAX 256
+
+/* A transfer of COUNT consecutive sectors, started with
+   block_submit().  Initialize with block_request_init(). */
+struct block_request
+  {
+    struct list_elem elem;      /* Element in the driver's queue. */
+    struct block *block;        /* Device first submitted to. */
+    void *dev;                  /* Owned by the driver. */
+    block_sector_t sector;      /* First sector. */
+    size_t count;               /* Number of sectors. */
+    void *buffer;               /* COUNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* True to write BUFFER, false to read. */
+    int64_t submit_time;        /* Timer tick when submitted. */
+    int64_t start_time;         /* Timer tick when issued by the driver. */
+    struct semaphore done;      /* Up'd when the transfer completes. */
   };
 
+void block_request_done (struct block_request *);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
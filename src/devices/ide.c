@@ -3,12 +3,16 @@
 #include <debug.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <list.h>
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -34,6 +38,34 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
+
+/* PCI bus-master IDE port addresses, relative to the channel's
+   bus-master base.  See [SFF-8038i]. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table addr. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start/stop bus-master transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ACTIVE 0x01      /* Transfer in progress. */
+#define BM_STA_ERROR 0x02       /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Drive raised IRQ (write 1 to clear). */
+
+/* One entry in a bus-master Physical Region Descriptor table.
+   Describes a physically contiguous buffer that does not cross a
+   64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical base address, even. */
+    uint16_t size;              /* Byte count, 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -43,12 +75,18 @@
 #define DEV_LBA 0x40            /* Linear based addressing. */
 #define DEV_DEV 0x10            /* Select device: 0=master, 1=slave. */
 
+/* Most sectors one READ/WRITE SECTOR command can transfer.
+   A sector count register value of 0 means 256. */
+#define MAX_SECTORS_PER_CMD 256
+
 /* Commands.
    Many more are defined but this is the small subset that we
    use. */
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
 
 /* An ATA device. */
 struct ata_disk
@@ -67,10 +105,23 @@ struct channel
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
 
-    struct lock lock;           /* Must acquire to access the controller. */
+    struct lock lock;           /* Protects queue. */
+    struct list queue;          /* Pending struct block_requests. */
+    struct condition queue_ready;       /* Signaled when queue grows. */
+    uint64_t head;              /* Request key just past the last command. */
+
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
+    bool busy;                  /* Is a command in progress? */
+
+    /* Statistics. */
+    unsigned long long cmd_cnt;         /* Commands issued. */
+    unsigned long long request_cnt;     /* Requests completed. */
+    unsigned long long seek_distance;   /* Sum of sector distances moved. */
+
+    uint16_t bm_base;           /* Bus-master registers, 0 if PIO only. */
+    struct prd *prdt;           /* PRD table for bus-master DMA. */
 
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
@@ -81,14 +132,25 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+/* Scheduling policy for every channel's queue.
+   Set by the kernel command-line option "-iosched". */
+enum ide_sched ide_sched = IDE_SCHED_CLOOK;
+
+static void find_bus_master (void);
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
+static void dispatcher (void *channel);
+static void pio_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          struct list *batch, bool write);
+static bool dma_usable (const struct channel *, struct list *batch);
+static void dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          struct list *batch, bool write);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -96,6 +158,8 @@ static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
+static bool request_less (const struct list_elem *, const struct list_elem *,
+                          void *aux);
 
 /* Initialize the disk subsystem and detect disks. */
 void
@@ -103,6 +167,7 @@ ide_init (void)
 {
   size_t chan_no;
 
+  find_bus_master ();
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -124,8 +189,13 @@ ide_init (void)
           NOT_REACHED ();
         }
       lock_init (&c->lock);
+      list_init (&c->queue);
+      cond_init (&c->queue_ready);
+      c->head = 0;
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->busy = false;
+      c->cmd_cnt = c->request_cnt = c->seek_distance = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -148,6 +218,11 @@ ide_init (void)
       if (check_device_type (&c->devices[0]))
         check_device_type (&c->devices[1]);
 
+      /* From here on, all transfers go through the queue.
+         Registering a disk below already reads its partition
+         table that way. */
+      thread_create (c->name, PRI_DEFAULT, dispatcher, c);
+
       /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
@@ -155,6 +230,74 @@ ide_init (void)
     }
 }
 
+/* PCI configuration space access.  See [PCI]. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns the 32-bit PCI configuration register at byte offset REG
+   of function FUNC of device DEV on bus BUS. */
+static uint32_t
+pci_read_config (int bus, int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11)
+        | (func << 8) | (reg & 0xfc));
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit PCI configuration register at byte
+   offset REG of function FUNC of device DEV on bus BUS. */
+static void
+pci_write_config (int bus, int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (bus << 16) | (dev << 11)
+        | (func << 8) | (reg & 0xfc));
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as a bus
+   master, such as the PIIX emulated by QEMU and Bochs.  If one is
+   found, enables bus mastering and sets up both channels for DMA.
+   Otherwise leaves them in PIO mode. */
+static void
+find_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t id = pci_read_config (0, dev, func, 0x00);
+        uint32_t class = pci_read_config (0, dev, func, 0x08);
+        uint32_t bar4;
+        size_t chan_no;
+
+        if ((id & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage (01), IDE (01), bus-master capable. */
+        if ((class >> 16) != 0x0101 || !(class & 0x8000))
+          continue;
+
+        bar4 = pci_read_config (0, dev, func, 0x20);
+        if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+          continue;
+
+        /* Enable I/O space and bus mastering. */
+        pci_write_config (0, dev, func, 0x04,
+                          pci_read_config (0, dev, func, 0x04) | 0x5);
+
+        for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+          {
+            struct channel *c = &channels[chan_no];
+            c->bm_base = (bar4 & ~3u) + chan_no * 8;
+            c->prdt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+          }
+        printf ("ide: bus-master DMA at I/O port 0x%04"PRIx32"\n",
+                bar4 & ~3u);
+        return;
+      }
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -337,63 +480,178 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Request scheduling. */
+
+/* Returns the position of request R on its channel, for ordering:
+   all of device 0's sectors come before device 1's. */
+static uint64_t
+request_key (const struct block_request *r)
+{
+  const struct ata_disk *d = r->dev;
+  return ((uint64_t) d->dev_no << 32) | r->sector;
+}
+
+/* Returns true if request A precedes request B on the disk. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+  return request_key (a) < request_key (b);
+}
+
+/* Removes the next request to dispatch from C's queue, which must
+   not be empty, and moves it into BATCH.  Under C-LOOK the queue
+   is sorted by position, so this is the first request at or past
+   the head, wrapping around to the lowest one; requests that
+   continue it in the same direction are merged into BATCH too, up
+   to MAX_SECTORS_PER_CMD sectors.  Returns the number of sectors
+   in BATCH.  C's lock must be held. */
+static size_t
+take_batch (struct channel *c, struct list *batch)
+{
+  struct block_request *first = NULL;
+  struct list_elem *e;
+  size_t cnt;
+
+  ASSERT (!list_empty (&c->queue));
+
+  if (ide_sched == IDE_SCHED_CLOOK)
+    for (e = list_begin (&c->queue); e != list_end (&c->queue);
+         e = list_next (e))
+      {
+        struct block_request *r = list_entry (e, struct block_request, elem);
+        if (request_key (r) >= c->head)
+          {
+            first = r;
+            break;
+          }
+      }
+  if (first == NULL)
+    first = list_entry (list_front (&c->queue), struct block_request, elem);
+
+  e = list_remove (&first->elem);
+  list_push_back (batch, &first->elem);
+  cnt = first->count;
+
+  if (ide_sched == IDE_SCHED_CLOOK)
+    while (e != list_end (&c->queue))
+      {
+        struct block_request *r = list_entry (e, struct block_request, elem);
+        if (r->dev != first->dev || r->write != first->write
+            || r->sector != first->sector + cnt
+            || cnt + r->count > MAX_SECTORS_PER_CMD)
+          break;
+        e = list_remove (e);
+        list_push_back (batch, &r->elem);
+        cnt += r->count;
+      }
+
+  return cnt;
+}
+
+/* Channel dispatcher thread.  Takes batches of requests off
+   channel C's queue, issues one command for each batch, and
+   completes the requests once it has finished.  Each channel has
+   its own dispatcher, so both channels can have a command in
+   flight at once.  Being the only thread
+   that issues commands after initialization, it needs no lock for
+   the controller itself. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+dispatcher (void *c_)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+  struct channel *c = c_;
+
+  for (;;)
+    {
+      struct block_request *first;
+      struct ata_disk *d;
+      struct list batch;
+      struct list_elem *e;
+      int64_t now;
+      uint64_t key;
+      size_t cnt;
+
+      list_init (&batch);
+      lock_acquire (&c->lock);
+      while (list_empty (&c->queue))
+        cond_wait (&c->queue_ready, &c->lock);
+      cnt = take_batch (c, &batch);
+      lock_release (&c->lock);
+
+      first = list_entry (list_front (&batch), struct block_request, elem);
+      d = first->dev;
+      now = timer_ticks ();
+      for (e = list_begin (&batch); e != list_end (&batch); e = list_next (e))
+        list_entry (e, struct block_request, elem)->start_time = now;
+      key = request_key (first);
+      c->seek_distance += key > c->head ? key - c->head : c->head - key;
+      c->head = key + cnt;
+      c->cmd_cnt++;
+
+      c->busy = true;
+      if (dma_usable (c, &batch))
+        dma_transfer (d, first->sector, cnt, &batch, first->write);
+      else
+        pio_transfer (d, first->sector, cnt, &batch, first->write);
+      c->busy = false;
+
+      while (!list_empty (&batch))
+        {
+          e = list_pop_front (&batch);
+          c->request_cnt++;
+          block_request_done (list_entry (e, struct block_request, elem));
+        }
+    }
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Queues request R for disk D on D's channel, where the channel's
+   dispatcher will pick it up.  Returns without waiting.  The
+   transfer runs in the dispatcher thread, which cannot reach the
+   submitter's user pages, so R's buffer must be in kernel
+   memory. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_submit (void *d_, struct block_request *r)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+
+  ASSERT (r->count <= MAX_SECTORS_PER_CMD);
+  ASSERT (is_kernel_vaddr (r->buffer));
+
+  r->dev = d;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  if (ide_sched == IDE_SCHED_CLOOK)
+    list_insert_ordered (&c->queue, &r->elem, request_less, NULL);
+  else
+    list_push_back (&c->queue, &r->elem);
+  cond_signal (&c->queue_ready, &c->lock);
   lock_release (&c->lock);
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,                       /* read */
+    NULL,                       /* write */
+    NULL,                       /* read_multiple */
+    NULL,                       /* write_multiple */
+    ide_submit
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_SECTORS_PER_CMD);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_SECTORS_PER_CMD ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -430,6 +688,152 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Issues one PIO command that transfers CNT sectors starting at
+   SEC_NO between disk D and the buffers of the requests in BATCH,
+   in order, reading from the disk unless WRITE is true.  The disk
+   interrupts once per sector. */
+static void
+pio_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              struct list *batch, bool write)
+{
+  struct channel *c = d->channel;
+  struct list_elem *e;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_SECTOR_RETRY
+                              : CMD_READ_SECTOR_RETRY);
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uint8_t *p = r->buffer;
+      size_t i;
+
+      for (i = 0; i < r->count; i++, sec_no++, p += BLOCK_SECTOR_SIZE)
+        {
+          if (!write)
+            sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+                   write ? "write" : "read", sec_no);
+          if (write)
+            {
+              output_sector (c, p);
+              sema_down (&c->completion_wait);
+            }
+          else
+            input_sector (c, p);
+        }
+    }
+}
+
+/* Returns true if the requests in BATCH can be transferred by
+   bus-master DMA on channel C: C has a bus master, every buffer
+   is at an even address, and the PRD entries fit in one page.
+   Buffers are in kernel memory (see ide_submit()), so each is
+   physically contiguous. */
+static bool
+dma_usable (const struct channel *c, struct list *batch)
+{
+  struct list_elem *e;
+  size_t prd_cnt = 0;
+
+  if (c->bm_base == 0)
+    return false;
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (((uintptr_t) r->buffer & 1) != 0)
+        return false;
+      prd_cnt += r->count * BLOCK_SECTOR_SIZE / 0x10000 + 2;
+    }
+  return prd_cnt <= PRD_CNT;
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and the
+   buffers of the requests in BATCH by bus-master DMA, reading from
+   the disk unless WRITE is true.  The controller moves the data
+   itself, so the CPU is free for other threads until the
+   completion interrupt. */
+static void
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              struct list *batch, bool write)
+{
+  struct channel *c = d->channel;
+  struct prd *prd = c->prdt;
+  struct list_elem *e;
+  uint8_t bm_status;
+
+  /* Build the PRD table, splitting at 64 kB boundaries. */
+  for (e = list_begin (batch); e != list_end (batch); e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uint8_t *p = r->buffer;
+      size_t left = r->count * BLOCK_SECTOR_SIZE;
+
+      while (left > 0)
+        {
+          uint32_t phys = vtop (p);
+          size_t size = 0x10000 - (phys & 0xffff);
+          if (size > left)
+            size = left;
+          prd->addr = phys;
+          prd->size = size & 0xffff;
+          prd->flags = 0;
+          prd++;
+          p += size;
+          left -= size;
+        }
+    }
+  prd[-1].flags = PRD_EOT;
+
+  /* Program the bus master, then the disk, then start. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c), BM_STA_ERROR | BM_STA_INTR);
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+
+  sema_down (&c->completion_wait);
+
+  outb (reg_bm_command (c), 0);
+  bm_status = inb (reg_bm_status (c));
+  if ((bm_status & BM_STA_ERROR) || (inb (reg_alt_status (c)) & STA_ERR))
+    PANIC ("%s: disk DMA %s failed, sector=%"PRDSNu, d->name,
+           write ? "write" : "read", sec_no);
+}
+
+/* Returns true if a command is in progress on either channel,
+   e.g. so the scheduler can tell idle time spent waiting for the
+   disk from truly idle time. */
+bool
+ide_busy (void)
+{
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    if (channels[chan_no].busy)
+      return true;
+  return false;
+}
+
+/* Prints statistics for each channel that has issued a command. */
+void
+ide_print_stats (void)
+{
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      if (c->cmd_cnt > 0)
+        printf ("%s (%s): %llu commands for %llu requests, "
+                "%llu sectors of seeking\n",
+                c->name, ide_sched == IDE_SCHED_FIFO ? "fifo" : "c-look",
+                c->cmd_cnt, c->request_cnt, c->seek_distance);
+    }
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -514,6 +918,8 @@ interrupt_handler (struct intr_frame *f)
         if (c->expecting_interrupt) 
           {
             inb (reg_status (c));               /* Acknowledge interrupt. */
+            if (c->bm_base != 0)                /* Clear bus-master IRQ. */
+              outb (reg_bm_status (c), BM_STA_INTR);
             sema_up (&c->completion_wait);      /* Wake up waiter. */
           }
         else
@@ -1,6 +1,19 @@
 #ifndef DEVICES_IDE_H
 #define DEVICES_IDE_H
 
+#include <stdbool.h>
+
+/* Order in which queued disk requests are dispatched. */
+enum ide_sched
+  {
+    IDE_SCHED_CLOOK,            /* Sweep upward by sector, merging. */
+    IDE_SCHED_FIFO              /* Arrival order, no merging. */
+  };
+
+extern enum ide_sched ide_sched;
+
 void ide_init (void);
+bool ide_busy (void);
+void ide_print_stats (void);
 
 #endif /* devices/ide.h */
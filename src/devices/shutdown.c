@@ -11,7 +11,11 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
 #include "filesys/filesys.h"
+#include "filesys/buffer_cache.h"
+#include "filesys/directory.h"
+#include "filesys/free-map.h"
 #endif
 
 /* Keyboard control register port. */
@@ -122,6 +126,10 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  ide_print_stats ();
+  cache_print_stats ();
+  free_map_print_stats ();
+  dir_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -1,35 +1,82 @@
 #include "filesys/buffer_cache.h"
 #include <bitmap.h>
 #include <hash.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "threads/thread.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 #include "devices/timer.h"
 
 //added 4 this whole file is added in lab 4
-#define NUM_BLOCKS 64
- 
-//static void *cache_base_addr; //base address of the cache 
-//static struct buffer_head buffer_heads[64]; //array of buffer heads
-static struct lock cache_lock; //cache lock
+
+/* Number of sectors the cache holds.  Set by kernel command-line
+   option "-bc=N". */
+size_t cache_size = CACHE_DEFAULT_SIZE;
+
+static void *cache_base_addr; //base address of the cache data, page aligned
+static struct buffer_head *buffer_heads; //array of cache_size buffer heads
+static size_t cache_cnt;        //number of heads handed out so far
+static size_t clock_hand;       //next head cache_evict() looks at
+static struct lock cache_lock; //protects the hash, the clock and pin counts
+static struct condition cache_unpinned; //signaled when a head's pin_cnt drops to 0
 static struct hash cache_hash; //cache hashmap
-static struct list cache_list; //buffer head list
 
-/*
-struct buffer_head {
-	bool dirty;	//dirty flag
-	bool being_used; //being used flag
-	bool access; 	//access flag (whether accessed recently)
-	block_sector_t sector; //on-disk location 
-	//size_t index; 
-	struct hash_elem he; 	
-	struct list_elem le;
-	uint8_t data[512];//just added data under the header cuz separate buffercache complicated the whole design
-};
-*/
+/* Victim selection policy.  Set by kernel command-line option
+   "-bcp=fifo|clock". */
+enum cache_policy cache_policy = CACHE_CLOCK;
+
+/* Write-behind: the flusher wakes every cache_flush_interval ticks
+   ("-wb=TICKS"), or as soon as cache_dirty_ratio percent of the
+   cache is dirty ("-wbr=PERCENT"), and writes all dirty buffers
+   back in ascending sector order. */
+int64_t cache_flush_interval = CACHE_DEFAULT_FLUSH_INTERVAL;
+int cache_dirty_ratio = CACHE_DEFAULT_DIRTY_RATIO;
+static size_t cache_dirty_cnt;  //# of dirty heads, protected by cache_lock
+static struct thread *flusher;  //write-behind thread, once it runs
+static struct lock flush_lock;  //one flush at a time, protects flush_order
+static struct buffer_head **flush_order; //cache_size heads, sorted for a flush
+static uint8_t *flush_buf;      //CACHE_IO_MAX sectors, protected by flush_lock
+
+/* How cache_get() should treat a buffer. */
+enum cache_flags
+  {
+    BC_WRITE = 001,             /* Lock for writing, not reading. */
+    BC_FILL = 002,              /* Read the sector from disk on a miss. */
+    BC_PREFETCH = 004,          /* Read-ahead, not a demand access. */
+    BC_NOWAIT = 010,            /* Fail rather than wait for a free head. */
+    BC_RUN = 020                /* Loading for a read that follows. */
+  };
+
+/* Most sectors merged into one multi-sector transfer: one page. */
+#define CACHE_IO_MAX (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Read-ahead requests, queued by cache_read_ahead() and served by
+   the read-ahead daemon.  A full queue drops new hints.  Runs of
+   consecutive queued sectors are read with one command through
+   ra_buf. */
+#define RA_QUEUE_SIZE 32
+static block_sector_t ra_queue[RA_QUEUE_SIZE];
+static size_t ra_head, ra_cnt;  //oldest request, # of requests
+static struct lock ra_lock;     //protects ra_queue
+static struct condition ra_not_empty; //signaled when a request is queued
+static uint8_t *ra_buf;         //CACHE_IO_MAX sectors, owned by the daemon
+
+static struct buffer_head *cache_evict (void);
+static thread_func read_ahead_daemon NO_RETURN;
+static thread_func write_behind_daemon NO_RETURN;
+
+/* Statistics. */
+static long long cache_hit_cnt;         /* # of lookups found in cache. */
+static long long cache_miss_cnt;        /* # of lookups that went to disk. */
+static long long cache_prefetch_cnt;    /* # of sectors read ahead. */
+static long long cache_prefetch_hit_cnt; /* # of hits on read-ahead sectors. */
+
 static unsigned cache_hash_func(const struct hash_elem *e , void *aux UNUSED){
 
   struct buffer_head *bh;
@@ -47,25 +94,52 @@ static bool cache_less_func(struct hash_elem *A , struct hash_elem *B , void *au
 }
 
 
+/* Sets up the cache.  All cache_size heads and their data are
+   allocated here, once: the data as one page-aligned region from
+   palloc (1 pg = 4096 bytes = 8 sectors), the heads as one array,
+   so nothing on the I/O path ever allocates memory. */
 void buffer_cache_init (){
-//	cache_base_addr=palloc_get_multiple(PAL_ASSERT,8); //1 pg = 4096 bytes = 8 blocks. get 8pgs
-//	buffer_heads=(struct buffer_head *) malloc(sizeof (struct buffer_head)*64);
+	size_t data_pages = DIV_ROUND_UP(cache_size * BLOCK_SECTOR_SIZE, PGSIZE);
+	size_t i;
+
+	ASSERT(cache_size > 0);
+	cache_base_addr=palloc_get_multiple(PAL_ASSERT, data_pages);
+	buffer_heads=calloc(cache_size, sizeof *buffer_heads);
+	flush_order=calloc(cache_size, sizeof *flush_order);
+	if(buffer_heads == NULL || flush_order == NULL)
+		PANIC("buffer cache: can't allocate %zu buffer heads", cache_size);
+
 	lock_init(&cache_lock);
+	cond_init(&cache_unpinned);
 	hash_init(&cache_hash, (hash_hash_func *) &cache_hash_func, (hash_less_func *) &cache_less_func, NULL);
-	list_init(&cache_list);
+	for(i = 0; i < cache_size; i++){
+		buffer_heads[i].data = (uint8_t *) cache_base_addr + i * BLOCK_SECTOR_SIZE;
+		rw_lock_init(&buffer_heads[i].rwlock);
+		buffer_heads[i].being_used = false;
+		buffer_heads[i].pin_cnt = 0;
+	}
+	cache_cnt = 0;
+	clock_hand = 0;
+	cache_dirty_cnt = 0;
+	lock_init(&flush_lock);
+	flush_buf=palloc_get_page(PAL_ASSERT);
+	ra_buf=palloc_get_page(PAL_ASSERT);
+
+	lock_init(&ra_lock);
+	cond_init(&ra_not_empty);
+	ra_head = ra_cnt = 0;
+	thread_create("read-ahead", PRI_DEFAULT, read_ahead_daemon, NULL);
 }
 
 //find cache entry with sector no. If not found, return NULL
-struct buffer_head * cache_lookup(block_sector_t sector){
+//cache_lock must be held
+static struct buffer_head * cache_lookup(block_sector_t sector){
 
   struct buffer_head bh;
   bh.sector = sector;
-  
-  lock_acquire(&cache_lock);
- 
-  struct hash_elem *h_elem = hash_find(&cache_hash,&bh.he);
 
-  lock_release(&cache_lock);
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  struct hash_elem *h_elem = hash_find(&cache_hash,&bh.he);
 
   if(h_elem == NULL){
 	return NULL;
@@ -74,179 +148,622 @@ struct buffer_head * cache_lookup(block_sector_t sector){
   return hash_entry(h_elem,struct buffer_head , he);
 }
 
+/* Drops a pin on BH taken by cache_get().  cache_lock must be
+   held. */
+static void
+cache_unpin (struct buffer_head *bh)
+{
+  ASSERT (bh->pin_cnt > 0);
+  if (--bh->pin_cnt == 0)
+    cond_broadcast (&cache_unpinned, &cache_lock);
+}
+
+/* Writes BH back to disk if it is dirty.  BH must be pinned and
+   cache_lock must not be held; readers of BH may proceed during
+   the write, writers wait for it.  The dirty bit is tested and
+   cleared under cache_lock so that two concurrent write-backs of
+   BH write it only once. */
+static void
+cache_write_back (struct buffer_head *bh)
+{
+  bool dirty;
+
+  rw_lock_read_acquire (&bh->rwlock);
+  lock_acquire (&cache_lock);
+  dirty = bh->dirty;
+  if (dirty)
+    {
+      bh->dirty = false;
+      cache_dirty_cnt--;
+    }
+  lock_release (&cache_lock);
+  if (dirty)
+    block_write (fs_device, bh->sector, bh->data);
+  rw_lock_read_release (&bh->rwlock);
+}
+
+/* Counts one more dirty head toward the dirty ratio, waking the
+   flusher early once it is reached.  Placeholder heads, which the
+   flusher cannot write, are not counted.  cache_lock must be
+   held. */
+static void
+cache_count_dirty (void)
+{
+  cache_dirty_cnt++;
+  if (flusher != NULL
+      && cache_dirty_cnt * 100 >= cache_size * cache_dirty_ratio)
+    timer_wake (flusher);
+}
+
+/* Marks BH, which the caller holds write-locked, dirty.  Wakes the
+   flusher early once the dirty ratio threshold is reached. */
+static void
+cache_mark_dirty (struct buffer_head *bh)
+{
+  if (bh->dirty)
+    return;
+
+  lock_acquire (&cache_lock);
+  bh->dirty = true;
+  if (bh->sector < CACHE_VIRTUAL_BASE)
+    cache_count_dirty ();
+  lock_release (&cache_lock);
+}
+
+/* Returns the head caching SECTOR, pinned and locked for writing
+   if FLAGS has BC_WRITE or for reading otherwise.  On a miss a free
+   or evicted head is installed in the hash *before* the disk read,
+   in the "I/O in progress" state with its lock held for writing, so
+   a second thread missing on the same sector finds it and sleeps on
+   the lock instead of reading the sector a second time.  The sector
+   is read from disk only if FLAGS has BC_FILL.  Otherwise BC_WRITE
+   is required, and a newly loaded head comes back still marked
+   io_pending with undefined contents: the caller must overwrite
+   all of it before cache_put().  BC_PREFETCH marks a read-ahead
+   rather than a demand access, for the statistics.  BC_RUN marks a
+   load for a demand read that follows: a miss is counted now, and
+   that read is not counted again as a hit; a hit is left for that
+   read to count.  With BC_NOWAIT, returns a null pointer instead of
+   waiting when every head is pinned. */
+static struct buffer_head *
+cache_get (block_sector_t sector, enum cache_flags flags)
+{
+  bool write = (flags & BC_WRITE) != 0;
+  struct buffer_head *bh;
+
+  ASSERT (write || (flags & BC_FILL));
+
+  lock_acquire (&cache_lock);
+  for (;;)
+    {
+      bh = cache_lookup (sector);
+      if (bh != NULL)
+        {
+          /* Hit (possibly on a sector another thread is still
+             reading in; the lock below waits for it). */
+          if (!(flags & (BC_PREFETCH | BC_RUN)))
+            {
+              if (bh->miss_counted)
+                bh->miss_counted = false;
+              else
+                cache_hit_cnt++;
+              if (bh->prefetched)
+                cache_prefetch_hit_cnt++;
+              bh->prefetched = false;
+            }
+          bh->pin_cnt++;
+          lock_release (&cache_lock);
+          if (write)
+            rw_lock_write_acquire (&bh->rwlock);
+          else
+            rw_lock_read_acquire (&bh->rwlock);
+          bh->access = true;
+          return bh;
+        }
+
+      if (cache_cnt < cache_size)
+        bh = &buffer_heads[cache_cnt++];
+      else
+        {
+          bh = cache_evict ();
+          if (bh == NULL)
+            {
+              /* Every head is pinned; wait for one to be put. */
+              if (flags & BC_NOWAIT)
+                {
+                  lock_release (&cache_lock);
+                  return NULL;
+                }
+              cond_wait (&cache_unpinned, &cache_lock);
+              continue;
+            }
+          if (bh->dirty)
+            {
+              /* Clean the victim without holding cache_lock, then
+                 start over: SECTOR may have been loaded meanwhile
+                 and the victim may have been touched again. */
+              bh->pin_cnt++;
+              lock_release (&cache_lock);
+              cache_write_back (bh);
+              lock_acquire (&cache_lock);
+              cache_unpin (bh);
+              continue;
+            }
+          if (bh->being_used)
+            hash_delete (&cache_hash, &bh->he);
+        }
+      break;
+    }
+
+  /* Miss: BH is unpinned and clean, so nobody holds its lock.  A
+     placeholder is only ever created by overwriting it whole. */
+  ASSERT (sector < CACHE_VIRTUAL_BASE || !(flags & BC_FILL));
+  if (flags & BC_PREFETCH)
+    cache_prefetch_cnt++;
+  else
+    cache_miss_cnt++;
+  bh->prefetched = (flags & BC_PREFETCH) != 0;
+  bh->miss_counted = (flags & BC_RUN) != 0;
+  bh->pin_cnt++;
+  rw_lock_write_acquire (&bh->rwlock);
+  bh->sector = sector;
+  bh->being_used = true;
+  bh->io_pending = true;
+  bh->access = true;
+  bh->dirty = false;
+  hash_insert (&cache_hash, &bh->he);
+  lock_release (&cache_lock);
+
+  if (flags & BC_FILL)
+    {
+      block_read (fs_device, sector, bh->data);
+      bh->io_pending = false;
+    }
+
+  if (!write)
+    {
+      rw_lock_write_release (&bh->rwlock);
+      rw_lock_read_acquire (&bh->rwlock);
+    }
+  return bh;
+}
+
+/* Unlocks and unpins BH, which was obtained from cache_get() with
+   the same WRITE. */
+static void
+cache_put (struct buffer_head *bh, bool write)
+{
+  if (write)
+    {
+      bh->io_pending = false;
+      rw_lock_write_release (&bh->rwlock);
+    }
+  else
+    rw_lock_read_release (&bh->rwlock);
+
+  lock_acquire (&cache_lock);
+  cache_unpin (bh);
+  lock_release (&cache_lock);
+}
+
 /*
 Read with buffer cache 
-1. find buffer head
-2. if exist, read data from buffer cache to buffer&update buffer_head
-3. if not exist, check cache is full
-4. If full, select victim entry & flush if necessary
-5. If not full,select empty entry & read data from disk to cache
-6. Then read data from buffer cache to buffer
+1. find buffer head (loading the sector on a miss)
+2. read data from buffer cache to buffer under the head's read lock
 */
-
 void cache_read(block_sector_t sector, void * buffer, int ofs, int chunk_size){
-	struct buffer_head *bh = cache_lookup(sector);
-	//If Read misses(no match)
-	if(bh==NULL){
-		//cache has empty space
-		if(list_size(&cache_list) < NUM_BLOCKS){
-			bh=(struct buffer_head*)malloc(sizeof(struct buffer_head));
-			bh->access=true;
-			bh->dirty = false;
-			bh->being_used = true;
-			bh->sector = sector;
-			//reading the whole block
-			if(ofs==0 && chunk_size == 512){
-				block_read(fs_device, sector, bh->data); //read from disk to cache(whole block)
-				memcpy(buffer,bh->data, chunk_size);//copy to buffer
-			} else { //reading partial
-				block_read(fs_device, sector, bh->data);
-				memset(bh->data, 0, ofs);
-				memcpy(buffer,bh->data+ofs, chunk_size);
-			}
-
-			//update buffer_head hashmap & add to cache list
-			lock_acquire(&cache_lock);
-			hash_insert(&cache_hash,&bh->he);
-			list_push_back(&cache_list,&bh->le);
-			lock_release(&cache_lock);
-		} else{ //cache full, so evict one
-			bh = cache_evict();
-			bh->sector = sector;
-			 bh->access=true;
-                        bh->dirty = false;
-                        bh->being_used = true;
-
-			//reading the whole block
-                        if(ofs==0 && chunk_size == 512){
-                                block_read(fs_device, sector, bh->data); //read from disk to cache(whole block)
-                                memcpy(buffer,bh->data, chunk_size);//copy to buffer
-                        } else { //reading partial
-                                block_read(fs_device, sector, bh->data);
-                                memset(bh->data, 0, ofs);
-                                memcpy(buffer,bh->data+ofs, chunk_size);
-                        }
-                
-                        //update buffer_head hashmap & add to cache list
-                        lock_acquire(&cache_lock);
-                        hash_insert(&cache_hash,&bh->he);
-                        lock_release(&cache_lock);
-			}
-		} else{//cache hit(existing already)
-			if(bh->being_used == true){
-				bh->access=true;
-				memcpy(buffer,bh->data+ofs,chunk_size);
-			} else {
-				PANIC("Cache Read Error! Existing Cache invalid");
-			}
-		}
-	}
-
+	struct buffer_head *bh = cache_get(sector, BC_FILL);
 
+	memcpy(buffer,bh->data+ofs,chunk_size);
+	cache_put(bh, false);
+}
 
 /*
-Write with buffer cache 
-1. find buffer head
-2. if exist, write buffer's data to cache & update header
-3. if not exist, check cache is full
-4. If full, select victim entry & flush if necessary
-5. If not full,select empty entry & read data from disk to cache
-6. Then write buffer's data to buffer cache
+Write with buffer cache (write-back)
+1. find buffer head (loading the sector on a miss, but without a
+   disk read when the whole sector is overwritten)
+2. write buffer's data to cache & mark it dirty under the head's
+   write lock.  The disk copy is only updated on eviction or
+   cache_flush_all().
 */
-void cache_write(block_sector_t sector, void * buffer, int ofs, int chunk_size){
-	struct buffer_head *bh = cache_lookup(sector);
-	//If Write misses(no match)
-	if(bh==NULL){
-		//cache has empty space
-		if(list_size(&cache_list) < NUM_BLOCKS){
-			bh=(struct buffer_head*)malloc(sizeof(struct buffer_head));
-			bh->access=true;
-			bh->dirty = false;
-			bh->being_used = true;
-			bh->sector = sector;
-			//writing the whole block
-			if(ofs==0 && chunk_size == 512){
-				block_write(fs_device, sector,buffer); //write whole block
-				memcpy(bh->data,buffer, chunk_size);//copy to cache
-			} else { //writing partial
-				int sector_length = 512 - ofs; //left over length
-				if(ofs > 0 || chunk_size < sector_length){
-					//read full block(only from offset will be used)
-					block_read(fs_device, sector, bh->data);
-				} else {
-					memset(bh->data, 0, 512);
-				}
-				memcpy(bh->data+ofs, buffer, chunk_size); //update cache
-				block_write(fs_device, sector, bh->data);//update disk block
-			}
-
-			//update buffer_head hashmap & add to cache list
-			lock_acquire(&cache_lock);
-			hash_insert(&cache_hash,&bh->he);
-			list_push_back(&cache_list,&bh->le);
-			lock_release(&cache_lock);
-		} else{ //cache full, so evict one
-			bh = cache_evict();
-			bh->sector = sector;
-			 bh->access=true;
-                        bh->dirty = false;
-                        bh->being_used = true;
-						
-			//writing the whole block
-                        if(ofs==0 && chunk_size == 512){                               
-				block_write(fs_device, sector,buffer); //write whole block
-                                memcpy(bh->data,buffer, chunk_size);//copy to cache
-                        } else { //writing partial
-                                int sector_length = 512 - ofs; //left over length
-                                if(ofs > 0 || chunk_size < sector_length){
-                                        //read full block(only from offset will be used)
-                                        block_read(fs_device, sector, bh->data);
-                                } else {
-                                        memset(bh->data, 0, 512);
-                                }
-                                memcpy(bh->data+ofs, buffer, chunk_size); //update cache
-                                block_write(fs_device, sector, bh->data);//update disk block
-                        }
-
-                        //update buffer_head hashmap & add to cache list
-                        lock_acquire(&cache_lock);
-                        hash_insert(&cache_hash,&bh->he);
-			lock_release(&cache_lock);
-
-
-			}
-		} else{//cache hit(existing already)
-			if(bh->being_used == true){
-				bh->access=true;
-				bh->dirty=true;
-				memcpy(bh->data+ofs,buffer,chunk_size);
-			} else {
-				PANIC("Cache Write Error! Existing Cache invalid");
-			}
-		}
-	}
+void cache_write(block_sector_t sector, const void * buffer, int ofs, int chunk_size){
+	struct buffer_head *bh = cache_get(sector, ofs != 0 || chunk_size != BLOCK_SECTOR_SIZE
+	                                   ? BC_WRITE | BC_FILL : BC_WRITE);
 
+	memcpy(bh->data+ofs,buffer,chunk_size);
+	cache_mark_dirty(bh);
+	cache_put(bh, true);
+}
 
+/* Brings the CNT consecutive sectors starting at FIRST into the
+   cache, for a caller about to read all of them.  The sectors that
+   miss are submitted to the block layer together, so the disk
+   driver can merge them into one command, and waited for at once.
+   Heads are taken in ascending sector order and never by waiting
+   for a free one, so this cannot deadlock against other users.
+   Returns the number of leading sectors dealt with, which is less
+   than CNT if the cache ran out of free heads or one batch filled
+   up; cache_read() loads any others one at a time. */
+size_t
+cache_read_run (block_sector_t first, size_t cnt)
+{
+  struct buffer_head *bhs[CACHE_IO_MAX];
+  struct block_request reqs[CACHE_IO_MAX];
+  size_t i, n = 0;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct buffer_head *bh;
+      bool cached;
+
+      lock_acquire (&cache_lock);
+      cached = cache_lookup (first + i) != NULL;
+      lock_release (&cache_lock);
+      if (cached)
+        continue;
+
+      bh = cache_get (first + i, BC_WRITE | BC_RUN | BC_NOWAIT);
+      if (bh == NULL)
+        break;
+      if (!bh->io_pending)
+        {
+          /* Someone else loaded it meanwhile. */
+          cache_put (bh, true);
+          continue;
+        }
+      block_request_init (&reqs[n], bh->sector, 1, bh->data, false);
+      block_submit (fs_device, &reqs[n]);
+      bhs[n++] = bh;
+      if (n == CACHE_IO_MAX)
+        {
+          i++;
+          break;
+        }
+    }
+  cnt = i;
+
+  for (i = 0; i < n; i++)
+    {
+      block_wait (&reqs[i]);
+      cache_put (bhs[i], true);
+    }
+  return cnt;
+}
 
+/* Takes BH, which is unpinned, out of the cache; its data is
+   discarded even if dirty.  cache_lock must be held. */
+static void
+cache_drop (struct buffer_head *bh)
+{
+  ASSERT (bh->pin_cnt == 0);
+  hash_delete (&cache_hash, &bh->he);
+  bh->being_used = false;
+  if (bh->dirty && bh->sector < CACHE_VIRTUAL_BASE)
+    cache_dirty_cnt--;
+  bh->dirty = false;
+}
 
-//evict a  cache if cache is full(first one for simplicity)
-struct buffer_head * cache_evict(){
-	struct list_elem * l_elem = list_begin(&cache_list);
-	struct buffer_head * bh;
+/* Moves the data cached under placeholder sector FROM, if any,
+   which must not be in use, to newly allocated sector TO.  The
+   data stays dirty and gets written to TO like any other.  A head
+   still caching TO from before it was last freed holds stale
+   data; it is dropped once nobody uses it. */
+void
+cache_move (block_sector_t from, block_sector_t to)
+{
+  struct buffer_head *bh, *stale;
+
+  ASSERT (from >= CACHE_VIRTUAL_BASE && to < CACHE_VIRTUAL_BASE);
+
+  lock_acquire (&cache_lock);
+  while ((stale = cache_lookup (to)) != NULL && stale->pin_cnt > 0)
+    cond_wait (&cache_unpinned, &cache_lock);
+  if (stale != NULL)
+    cache_drop (stale);
+
+  bh = cache_lookup (from);
+  if (bh != NULL)
+    {
+      ASSERT (bh->pin_cnt == 0);
+      hash_delete (&cache_hash, &bh->he);
+      bh->sector = to;
+      hash_insert (&cache_hash, &bh->he);
+      if (bh->dirty)
+        cache_count_dirty ();
+    }
+  lock_release (&cache_lock);
+}
 
-	bh = list_entry (l_elem, struct buffer_head, le);
-	if(bh!=NULL){
-	//if dirty, flush
-	if(bh-> dirty == true){
-		block_write(fs_device, bh->sector, bh->data);
-		bh->dirty = false;
-	}
-	hash_delete(&cache_hash,&bh->he);
-	return bh;
-	}
-	//no element in list
-	return NULL;
+/* Throws away the data cached under placeholder sector SECTOR, if
+   any, which must not be in use. */
+void
+cache_discard (block_sector_t sector)
+{
+  struct buffer_head *bh;
+
+  ASSERT (sector >= CACHE_VIRTUAL_BASE);
+
+  lock_acquire (&cache_lock);
+  bh = cache_lookup (sector);
+  if (bh != NULL)
+    cache_drop (bh);
+  lock_release (&cache_lock);
+}
+
+/* Asks the read-ahead daemon to bring SECTOR into the cache in the
+   background.  Never blocks on I/O; the hint is dropped if the
+   queue is full or SECTOR was the last hint queued. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&ra_lock);
+  if (ra_cnt < RA_QUEUE_SIZE
+      && (ra_cnt == 0
+          || ra_queue[(ra_head + ra_cnt - 1) % RA_QUEUE_SIZE] != sector))
+    {
+      ra_queue[(ra_head + ra_cnt) % RA_QUEUE_SIZE] = sector;
+      ra_cnt++;
+      cond_signal (&ra_not_empty, &ra_lock);
+    }
+  lock_release (&ra_lock);
+}
+
+/* Reads the sectors of the heads in BHS[0...CNT), which are for
+   consecutive sectors and freshly loaded by cache_get() without
+   BC_FILL, with a single command, and releases them. */
+static void
+cache_fill_run (struct buffer_head **bhs, size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  block_read_multiple (fs_device, bhs[0]->sector, cnt, ra_buf);
+  for (i = 0; i < cnt; i++)
+    {
+      memcpy (bhs[i]->data, ra_buf + i * BLOCK_SECTOR_SIZE, BLOCK_SECTOR_SIZE);
+      cache_put (bhs[i], true);
+    }
+}
+
+/* Brings the CNT sectors starting at FIRST into the cache.
+   Sectors that are already cached split the range; each remaining
+   run is read with one multi-sector command.  Heads are never
+   waited for, since the daemon may already hold the only ones
+   that could be freed: if the cache runs out of free heads, the
+   run gathered so far is read and the rest are skipped. */
+static void
+cache_prefetch (block_sector_t first, size_t cnt)
+{
+  struct buffer_head *bhs[CACHE_IO_MAX];
+  size_t i, n = 0;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct buffer_head *bh;
+      bool cached;
+
+      lock_acquire (&cache_lock);
+      cached = cache_lookup (first + i) != NULL;
+      lock_release (&cache_lock);
+      if (!cached)
+        {
+          bh = cache_get (first + i, BC_WRITE | BC_PREFETCH | BC_NOWAIT);
+          if (bh == NULL)
+            break;
+          if (bh->io_pending)
+            {
+              bhs[n++] = bh;
+              continue;
+            }
+          /* Someone else loaded it meanwhile. */
+          cache_put (bh, true);
+        }
+      cache_fill_run (bhs, n);
+      n = 0;
+    }
+  cache_fill_run (bhs, n);
+}
+
+/* Read-ahead daemon.  Reads the queued sectors into the cache so
+   that the sequential reader that asked for them finds them there
+   instead of waiting on the disk.  Holds at most a quarter of the
+   cache at once, so it cannot starve demand accesses. */
+static void
+read_ahead_daemon (void *aux UNUSED)
+{
+  size_t max_run = cache_size / 4;
+
+  if (max_run > CACHE_IO_MAX)
+    max_run = CACHE_IO_MAX;
+  if (max_run == 0)
+    max_run = 1;
+
+  for (;;)
+    {
+      block_sector_t first;
+      size_t cnt = 0;
+
+      lock_acquire (&ra_lock);
+      while (ra_cnt == 0)
+        cond_wait (&ra_not_empty, &ra_lock);
+      first = ra_queue[ra_head];
+      do
+        {
+          ra_head = (ra_head + 1) % RA_QUEUE_SIZE;
+          ra_cnt--;
+          cnt++;
+        }
+      while (cnt < max_run && ra_cnt > 0 && ra_queue[ra_head] == first + cnt);
+      lock_release (&ra_lock);
+
+      cache_prefetch (first, cnt);
+    }
+}
+
+/* Orders buffer head pointers by sector number. */
+static int
+compare_sector (const void *a_, const void *b_)
+{
+  const struct buffer_head *a = *(struct buffer_head *const *) a_;
+  const struct buffer_head *b = *(struct buffer_head *const *) b_;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Writes the heads in RUN[0...CNT), whose contents were copied
+   into flush_buf and which are held for reading, to their
+   consecutive sectors with one command, and releases them. */
+static void
+cache_write_run (struct buffer_head **run, size_t cnt)
+{
+  size_t i;
+
+  if (cnt == 0)
+    return;
+  block_write_multiple (fs_device, run[0]->sector, cnt, flush_buf);
+  for (i = 0; i < cnt; i++)
+    rw_lock_read_release (&run[i]->rwlock);
+}
+
+/* Writes every dirty buffer back to disk, in ascending sector
+   order so the disk sweeps in one direction.  Dirty buffers for
+   consecutive sectors are merged, up to CACHE_IO_MAX at a time,
+   into a single block_write_multiple().  The buffers stay cached
+   but clean. */
+static void
+cache_flush_dirty (void)
+{
+  struct buffer_head *run[CACHE_IO_MAX];
+  size_t i, cnt = 0, run_cnt = 0;
+
+  lock_acquire (&flush_lock);
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct buffer_head *bh = &buffer_heads[i];
+      if (bh->being_used && bh->dirty && bh->sector < CACHE_VIRTUAL_BASE)
+        {
+          bh->pin_cnt++;
+          flush_order[cnt++] = bh;
+        }
+    }
+  lock_release (&cache_lock);
+
+  qsort (flush_order, cnt, sizeof *flush_order, compare_sector);
+  for (i = 0; i < cnt; i++)
+    {
+      struct buffer_head *bh = flush_order[i];
+      bool dirty;
+
+      /* Same protocol as cache_write_back(), but the read lock is
+         kept until the merged write completes. */
+      rw_lock_read_acquire (&bh->rwlock);
+      lock_acquire (&cache_lock);
+      dirty = bh->dirty;
+      if (dirty)
+        {
+          bh->dirty = false;
+          cache_dirty_cnt--;
+        }
+      lock_release (&cache_lock);
+      if (!dirty)
+        {
+          rw_lock_read_release (&bh->rwlock);
+          continue;
+        }
+
+      if (run_cnt > 0 && (run_cnt == CACHE_IO_MAX
+                          || bh->sector != run[run_cnt - 1]->sector + 1))
+        {
+          cache_write_run (run, run_cnt);
+          run_cnt = 0;
+        }
+      memcpy (flush_buf + run_cnt * BLOCK_SECTOR_SIZE, bh->data,
+              BLOCK_SECTOR_SIZE);
+      run[run_cnt++] = bh;
+    }
+  cache_write_run (run, run_cnt);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    cache_unpin (flush_order[i]);
+  lock_release (&cache_lock);
+  lock_release (&flush_lock);
 }
 
+/* Writes every dirty buffer back to disk.  Called at
+   filesys_done() so nothing is lost at shutdown. */
+void
+cache_flush_all (void)
+{
+  cache_flush_dirty ();
+}
 
- 
+/* Starts the write-behind thread.  Called from filesys_init(). */
+void
+cache_write_behind_init (void)
+{
+  thread_create ("write-behind", PRI_DEFAULT, write_behind_daemon, NULL);
+}
+
+/* Write-behind thread.  Bounds how long data sits dirty in the
+   cache, and spreads the writes out instead of leaving them all
+   for eviction or shutdown. */
+static void
+write_behind_daemon (void *aux UNUSED)
+{
+  flusher = thread_current ();
+  for (;;)
+    {
+      timer_sleep (cache_flush_interval);
+      cache_flush_dirty ();
+    }
+}
+
+/* Picks a victim once all cache_size heads are in use.  Pinned
+   heads (in use by some thread, or with I/O in progress) are
+   never chosen, nor are placeholders, which have nowhere to be
+   written.  Returns a null pointer if every head is pinned.
+   The victim may still be dirty; cache_get() cleans it first.
+   cache_lock must be held.
+
+   With CACHE_CLOCK the hand sweeps the heads giving each one whose
+   access bit is set a second chance (clearing the bit), so hot
+   inode and directory sectors survive sequential scans.  With
+   CACHE_FIFO the access bit is ignored and the hand simply walks
+   the array, which evicts in insertion order. */
+static struct buffer_head *
+cache_evict (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  /* Two sweeps: the first may only clear access bits. */
+  for (i = 0; i < 2 * cache_size; i++)
+    {
+      struct buffer_head *bh = &buffer_heads[clock_hand];
+      clock_hand = (clock_hand + 1) % cache_size;
+      if (bh->pin_cnt > 0
+          || (bh->being_used && bh->sector >= CACHE_VIRTUAL_BASE))
+        continue;
+      if (cache_policy == CACHE_FIFO || !bh->access)
+        return bh;
+      bh->access = false;
+    }
+  return NULL;
+}
+
+/* Prints buffer cache statistics. */
+void
+cache_print_stats (void)
+{
+  long long total = cache_hit_cnt + cache_miss_cnt;
+
+  printf ("Buffer cache (%zu sectors, %s): %lld hits, %lld misses, hit rate %lld%%\n",
+          cache_size, cache_policy == CACHE_FIFO ? "fifo" : "clock",
+          cache_hit_cnt, cache_miss_cnt,
+          total > 0 ? cache_hit_cnt * 100 / total : 0);
+  printf ("Read-ahead: %lld sectors prefetched, %lld hits on them\n",
+          cache_prefetch_cnt, cache_prefetch_hit_cnt);
+}
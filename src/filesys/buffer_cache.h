@@ -1,10 +1,13 @@
 #ifndef FILESYS_BUFFER_CACHE_H
 #define FILESYS_BUFFER_CACHE_H
 
+#include <stddef.h>
 #include "devices/block.h"
+#include "devices/timer.h"
 #include "filesys/off_t.h"
 #include <hash.h>
 #include <list.h>
+#include "threads/synch.h"
 
 //this whole file is  added4 
 
@@ -13,17 +16,53 @@ struct buffer_head {
         bool being_used; //being used flag
         bool access;    //access flag (whether accessed recently)
         block_sector_t sector; //on-disk location 
-        //size_t index; 
+        bool prefetched; //read ahead and not yet used
+        bool miss_counted; //loaded by cache_read_run(), next read already counted as a miss
+        bool io_pending; //disk read in progress, lock held by the loader
+        int pin_cnt;    //# of threads using this head; pinned heads are never evicted
+        struct rw_lock rwlock; //protects data and dirty
         struct hash_elem he;
-        struct list_elem le;
-        uint8_t data[512];//just added data under the header cuz separate buffercache complicated the whole design
+        uint8_t *data;  //BLOCK_SECTOR_SIZE bytes in the page-aligned cache data region
 };
 
+/* Buffer cache replacement policy. */
+enum cache_policy
+  {
+    CACHE_CLOCK,                /* Second chance via the access bit. */
+    CACHE_FIFO                  /* Evict in insertion order. */
+  };
+
+extern enum cache_policy cache_policy;
+
+/* Default number of sectors in the cache. */
+#define CACHE_DEFAULT_SIZE 64
+
+extern size_t cache_size;
+
+/* Write-behind defaults: flush every 5 seconds, or as soon as half
+   of the cache is dirty. */
+#define CACHE_DEFAULT_FLUSH_INTERVAL (5 * TIMER_FREQ)
+#define CACHE_DEFAULT_DIRTY_RATIO 50
+
+extern int64_t cache_flush_interval;
+extern int cache_dirty_ratio;
+
+/* Sectors from here up are placeholders, not disk sectors: they
+   name data written to files that have no disk sectors yet (see
+   delayed allocation in inode.c).  Placeholder buffers are never
+   read from or written to disk, nor evicted; cache_move() turns
+   one into an ordinary buffer once its sector is allocated. */
+#define CACHE_VIRTUAL_BASE ((block_sector_t) 0x80000000)
 
 void buffer_cache_init(void);
-struct buffer_head * cache_lookup(block_sector_t sector);
 void cache_read(block_sector_t sector, void * buffer, int ofs, int chunk_size);
-void cache_write(block_sector_t sector, void * buffer, int ofs, int chunk_size);
-struct buffer_head * cache_evict(void);
+void cache_write(block_sector_t sector, const void * buffer, int ofs, int chunk_size);
+size_t cache_read_run (block_sector_t first, size_t cnt);
+void cache_move (block_sector_t from, block_sector_t to);
+void cache_discard (block_sector_t sector);
+void cache_read_ahead (block_sector_t sector);
+void cache_flush_all (void);
+void cache_write_behind_init (void);
+void cache_print_stats (void);
 
 #endif /* filesys/buffer_cache.h */
@@ -1,10 +1,12 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* A directory. */
 struct dir 
@@ -13,22 +15,358 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
+/* A directory entry.  Entries are packed one after another on
+   disk: REC_LEN covers the entry and any free space after it, up
+   to the next entry, and only the first NAME_LEN bytes of NAME are
+   stored, so a short name takes only a few bytes more than its
+   length.  A NAME_LEN of 0 marks a free record. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
+    uint16_t rec_len;                   /* Bytes up to the next entry. */
+    uint8_t name_len;                   /* Length of name, 0 if free. */
+    char name[NAME_MAX + 1];            /* Null terminated in memory. */
+  };
+
+/* Bytes an entry with a name of LEN characters takes on disk. */
+#define ENTRY_SIZE(LEN) (offsetof (struct dir_entry, name) + (LEN))
+
+/* A small directory is a single run of entries that fills its
+   file, which lookup() and dir_add() walk from the start.  Once
+   the run would outgrow DIR_LINEAR_MAX bytes the directory is
+   converted to an extendible hash keyed by hash_string() of the
+   name: block 0 of the file holds a struct dir_index whose table
+   maps the low DEPTH bits of the hash to a bucket block, and
+   every other block is a bucket, a struct dir_bucket followed by
+   a run of entries that fills the rest of the block.  A full
+   bucket is split in two on its next hash bit; one that already
+   uses DIR_MAX_DEPTH bits gets a chain of overflow blocks instead.
+
+   The first word of an indexed directory is DIR_INDEX_MAGIC,
+   which can never be the inode_sector of a linear entry. */
+#define DIR_INDEX_MAGIC 0x44495248      /* "DIRH" */
+#define DIR_LINEAR_MAX BLOCK_SECTOR_SIZE /* Linear bytes before indexing. */
+#define DIR_MAX_DEPTH 7                 /* Largest global depth. */
+
+/* Block 0 of an indexed directory. */
+struct dir_index
+  {
+    uint32_t magic;                     /* DIR_INDEX_MAGIC. */
+    uint16_t depth;                     /* Hash bits used by TABLE. */
+    uint16_t block_cnt;                 /* Blocks in use, counting this. */
+    uint16_t table[1 << DIR_MAX_DEPTH]; /* Hash bits to bucket block. */
+  };
+
+/* Start of each bucket block, followed by its entries. */
+struct dir_bucket
+  {
+    uint16_t depth;                     /* Hash bits shared by entries. */
+    uint16_t next;                      /* Overflow block, or 0. */
+  };
+
+/* A bucket block being built in memory by bucket_init() and
+   index_split(). */
+struct bucket_image
+  {
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Block contents. */
+    size_t end;                         /* End of the entries so far. */
+    size_t last;                        /* Last entry, or 0 if none. */
+  };
+
+/* Free space hints.  For a few recently changed linear
+   directories, the offset of the first entry that may have room
+   after it for another one, so that dir_add() need not walk the
+   entries before it looking for space.  dir_remove() moves a hint
+   back to the entry it frees space in. */
+#define DIR_HINT_CNT 16
+
+struct dir_hint
+  {
+    block_sector_t sector;              /* Directory's inode sector. */
+    off_t ofs;                          /* No room before this offset. */
+  };
+
+static struct dir_hint hints[DIR_HINT_CNT];
+static size_t hint_next;                /* Next hint to replace. */
+static struct lock hint_lock;           /* Protects the hints. */
+
+/* Every directory's entries are protected by inode_dir_lock() of
+   its inode, held shared by dir_lookup() and dir_readdir() and
+   exclusively by dir_add() and dir_remove(), which rewrite entries
+   in place. */
+
+/* Name cache.  Maps a (directory inode sector, name) pair to the
+   inode sector dir_lookup() found for it, or to DENTRY_NEGATIVE
+   if the name was not there, so that resolving a warm path does
+   not read any directory blocks.  dir_add() and dir_remove()
+   overwrite the entry for the name they change.  The DENTRY_CNT
+   entries are allocated statically and recycled in LRU order. */
+#define DENTRY_CNT 128
+#define DENTRY_NEGATIVE ((block_sector_t) -1)
+
+struct dentry
+  {
+    struct hash_elem elem;              /* In dentry_hash, if in use. */
+    struct list_elem lru_elem;          /* In dentry_lru, newest first. */
+    bool in_use;                        /* In dentry_hash? */
+    block_sector_t parent;              /* Directory's inode sector. */
+    block_sector_t sector;              /* Entry's inode sector. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+static struct dentry dentries[DENTRY_CNT];
+static struct hash dentry_hash;
+static struct list dentry_lru;
+static struct lock dentry_lock;         /* Protects all of the above. */
+
+/* Bumped by every change to a directory, so that a lookup that
+   raced with one does not cache what it saw before the change.
+   The directory lock keeps lookups from racing with changes to
+   the same directory, but not with dentry_purge() of it. */
+static unsigned dentry_gen;
+
+/* Statistics. */
+static long long dentry_hit_cnt;        /* # of names found in cache. */
+static long long dentry_miss_cnt;       /* # of names read from disk. */
+
+static unsigned
+dentry_hash_func (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, elem);
+  return hash_string (d->name) ^ hash_int ((int) d->parent);
+}
+
+static bool
+dentry_less_func (const struct hash_elem *a_, const struct hash_elem *b_,
+                  void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, elem);
+  if (a->parent != b->parent)
+    return a->parent < b->parent;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Initializes the name cache and the free space hints. */
+void
+dir_init (void)
+{
+  size_t i;
+
+  lock_init (&hint_lock);
+  hash_init (&dentry_hash, dentry_hash_func, dentry_less_func, NULL);
+  list_init (&dentry_lru);
+  lock_init (&dentry_lock);
+  for (i = 0; i < DENTRY_CNT; i++)
+    list_push_back (&dentry_lru, &dentries[i].lru_elem);
+}
+
+/* Returns the cached entry for NAME in the directory whose inode
+   is in PARENT, or a null pointer if there is none.
+   dentry_lock must be held. */
+static struct dentry *
+dentry_find (block_sector_t parent, const char *name)
+{
+  static struct dentry key;     /* Protected by dentry_lock. */
+  struct hash_elem *e;
+
+  key.parent = parent;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentry_hash, &key.elem);
+  return e != NULL ? hash_entry (e, struct dentry, elem) : NULL;
+}
+
+/* Looks up NAME in the directory whose inode is in PARENT.  On a
+   hit, stores the cached sector (or DENTRY_NEGATIVE) in *SECTOR
+   and returns true.  On a miss, stores the current generation in
+   *GEN, to be passed to dentry_fill(), and returns false. */
+static bool
+dentry_get (block_sector_t parent, const char *name,
+            block_sector_t *sector, unsigned *gen)
+{
+  struct dentry *d;
+
+  lock_acquire (&dentry_lock);
+  d = dentry_find (parent, name);
+  if (d != NULL)
+    {
+      dentry_hit_cnt++;
+      *sector = d->sector;
+      list_remove (&d->lru_elem);
+      list_push_front (&dentry_lru, &d->lru_elem);
+    }
+  else
+    {
+      dentry_miss_cnt++;
+      *gen = dentry_gen;
+    }
+  lock_release (&dentry_lock);
+  return d != NULL;
+}
+
+/* Caches SECTOR as the entry for NAME in the directory whose
+   inode is in PARENT, replacing any older entry for it or else
+   the least recently used one.  dentry_lock must be held. */
+static void
+dentry_store (block_sector_t parent, const char *name, block_sector_t sector)
+{
+  struct dentry *d = dentry_find (parent, name);
+
+  if (d == NULL)
+    {
+      d = list_entry (list_back (&dentry_lru), struct dentry, lru_elem);
+      if (d->in_use)
+        hash_delete (&dentry_hash, &d->elem);
+      d->in_use = true;
+      d->parent = parent;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentry_hash, &d->elem);
+    }
+  d->sector = sector;
+  list_remove (&d->lru_elem);
+  list_push_front (&dentry_lru, &d->lru_elem);
+}
+
+/* Caches the result of reading NAME from the directory whose
+   inode is in PARENT from disk, unless some directory changed
+   since dentry_get() returned generation GEN. */
+static void
+dentry_fill (block_sector_t parent, const char *name, block_sector_t sector,
+             unsigned gen)
+{
+  lock_acquire (&dentry_lock);
+  if (gen == dentry_gen)
+    dentry_store (parent, name, sector);
+  lock_release (&dentry_lock);
+}
+
+/* Records that NAME in the directory whose inode is in PARENT
+   now refers to SECTOR, or to nothing if SECTOR is
+   DENTRY_NEGATIVE. */
+static void
+dentry_set (block_sector_t parent, const char *name, block_sector_t sector)
+{
+  lock_acquire (&dentry_lock);
+  dentry_gen++;
+  dentry_store (parent, name, sector);
+  lock_release (&dentry_lock);
+}
+
+/* Drops every cached entry for names in the directory whose inode
+   is in PARENT, which is being removed. */
+static void
+dentry_purge (block_sector_t parent)
+{
+  size_t i;
+
+  lock_acquire (&dentry_lock);
+  dentry_gen++;
+  for (i = 0; i < DENTRY_CNT; i++)
+    {
+      struct dentry *d = &dentries[i];
+      if (d->in_use && d->parent == parent)
+        {
+          hash_delete (&dentry_hash, &d->elem);
+          d->in_use = false;
+          list_remove (&d->lru_elem);
+          list_push_back (&dentry_lru, &d->lru_elem);
+        }
+    }
+  lock_release (&dentry_lock);
+}
+
+/* Prints name cache statistics. */
+void
+dir_print_stats (void)
+{
+  printf ("Name cache: %lld hits, %lld misses\n",
+          dentry_hit_cnt, dentry_miss_cnt);
+}
+
+/* Returns the hint for the directory whose inode is in SECTOR,
+   or a null pointer if there is none.  hint_lock must be held. */
+static struct dir_hint *
+hint_find (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < DIR_HINT_CNT; i++)
+    if (hints[i].sector == sector)
+      return &hints[i];
+  return NULL;
+}
+
+/* Returns the offset at which dir_add() should start looking for
+   room in the directory whose inode is in SECTOR. */
+static off_t
+hint_get (block_sector_t sector)
+{
+  struct dir_hint *h;
+  off_t ofs;
+
+  lock_acquire (&hint_lock);
+  h = hint_find (sector);
+  ofs = h != NULL ? h->ofs : 0;
+  lock_release (&hint_lock);
+  return ofs;
+}
+
+/* Records that no entry before OFS in the directory whose inode
+   is in SECTOR has room for another entry. */
+static void
+hint_set (block_sector_t sector, off_t ofs)
+{
+  struct dir_hint *h;
+
+  lock_acquire (&hint_lock);
+  h = hint_find (sector);
+  if (h == NULL)
+    {
+      h = &hints[hint_next++ % DIR_HINT_CNT];
+      h->sector = sector;
+    }
+  h->ofs = ofs;
+  lock_release (&hint_lock);
+}
+
+/* Records that the entry at OFS in the directory whose inode is
+   in SECTOR may now have room after it. */
+static void
+hint_lower (block_sector_t sector, off_t ofs)
+{
+  struct dir_hint *h;
+
+  lock_acquire (&hint_lock);
+  h = hint_find (sector);
+  if (h != NULL && ofs < h->ofs)
+    h->ofs = ofs;
+  lock_release (&hint_lock);
+}
+
+/* Drops the hint for the directory whose inode is in SECTOR. */
+static void
+hint_forget (block_sector_t sector)
+{
+  struct dir_hint *h;
+
+  lock_acquire (&hint_lock);
+  h = hint_find (sector);
+  if (h != NULL)
+    h->sector = 0;
+  lock_release (&hint_lock);
+}
+
+/* Creates an empty directory in the given SECTOR.  Entries are
+   appended to it as they are added.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector)
 {
+  hint_forget (sector);
+
   //added4 3-1
   //set flag: 1
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry),1);
+  return inode_create (sector, 0, 1);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -85,34 +423,457 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Reads the entry at OFS in INODE into *E and null terminates
+   its name.  Returns true if successful, false at end of file or
+   if the entry is damaged. */
+static bool
+read_entry (struct inode *inode, off_t ofs, struct dir_entry *e)
+{
+  off_t size = inode_read_at (inode, e, ENTRY_SIZE (NAME_MAX), ofs);
+
+  if (size < (off_t) ENTRY_SIZE (0) || e->rec_len < ENTRY_SIZE (0)
+      || e->name_len > NAME_MAX || size < (off_t) ENTRY_SIZE (e->name_len))
+    return false;
+  e->name[e->name_len] = '\0';
+  return true;
+}
+
+/* Writes *E to OFS in INODE.
+   Returns true if successful, false on failure. */
+static bool
+write_entry (struct inode *inode, off_t ofs, const struct dir_entry *e)
+{
+  off_t size = ENTRY_SIZE (e->name_len);
+  return inode_write_at (inode, e, size, ofs) == size;
+}
+
+/* Sets the REC_LEN of the entry at OFS in INODE.
+   Returns true if successful, false on failure. */
+static bool
+write_rec_len (struct inode *inode, off_t ofs, uint16_t rec_len)
+{
+  return inode_write_at (inode, &rec_len, sizeof rec_len,
+                         ofs + offsetof (struct dir_entry, rec_len))
+         == sizeof rec_len;
+}
+
+/* Returns the number of free bytes in E's record. */
+static size_t
+entry_room (const struct dir_entry *e)
+{
+  return e->name_len == 0 ? e->rec_len : e->rec_len - ENTRY_SIZE (e->name_len);
+}
+
+/* Searches the run of entries from START to END in INODE for
+   NAME.  If successful, returns true and sets *EP, *OFSP and
+   *PREVP, each if non-null, to the entry, its offset and the
+   offset of the entry before it in the run (or -1 if it is the
+   first).  Otherwise returns false. */
+static bool
+find_entry (struct inode *inode, off_t start, off_t end, const char *name,
+            struct dir_entry *ep, off_t *ofsp, off_t *prevp)
+{
+  struct dir_entry e;
+  off_t ofs, prev = -1;
+
+  for (ofs = start; ofs < end && read_entry (inode, ofs, &e);
+       ofs += e.rec_len)
+    {
+      if (e.name_len != 0 && !strcmp (name, e.name))
+        {
+          if (ep != NULL)
+            *ep = e;
+          if (ofsp != NULL)
+            *ofsp = ofs;
+          if (prevp != NULL)
+            *prevp = prev;
+          return true;
+        }
+      prev = ofs;
+    }
+  return false;
+}
+
+/* Searches the run of entries from START to END in INODE for one
+   with room for SIZE more bytes.  If successful, returns true
+   and sets *EP and *OFSP to the entry and its offset.  Otherwise
+   returns false.  Either way, if FIRSTP is non-null, sets *FIRSTP
+   to the offset of the first entry seen with room for any entry
+   at all, or to END if there was none. */
+static bool
+find_room (struct inode *inode, off_t start, off_t end, size_t size,
+           struct dir_entry *ep, off_t *ofsp, off_t *firstp)
+{
+  struct dir_entry e;
+  off_t ofs, first = end;
+  bool found = false;
+
+  for (ofs = start; ofs < end && read_entry (inode, ofs, &e);
+       ofs += e.rec_len)
+    {
+      size_t room = entry_room (&e);
+      if (first == end && room >= ENTRY_SIZE (1))
+        first = ofs;
+      if (room >= size)
+        {
+          *ep = e;
+          *ofsp = ofs;
+          found = true;
+          break;
+        }
+    }
+  if (firstp != NULL)
+    *firstp = first;
+  return found;
+}
+
+/* Stores NEW in the room of entry *E at OFS in INODE, setting
+   NEW's REC_LEN.  E must have room for NEW.
+   Returns true if successful, false on failure. */
+static bool
+put_entry (struct inode *inode, off_t ofs, const struct dir_entry *e,
+           struct dir_entry *new)
+{
+  size_t used;
+
+  ASSERT (entry_room (e) >= ENTRY_SIZE (new->name_len));
+  if (e->name_len == 0)
+    {
+      new->rec_len = e->rec_len;
+      return write_entry (inode, ofs, new);
+    }
+
+  /* Split E's record.  Write NEW before shrinking E, so that
+     a reader never follows E's REC_LEN into unwritten bytes. */
+  used = ENTRY_SIZE (e->name_len);
+  new->rec_len = e->rec_len - used;
+  return (write_entry (inode, ofs + used, new)
+          && write_rec_len (inode, ofs, used));
+}
+
+/* Removes entry *E at OFS in INODE by marking its record free
+   and then, unless it is the first in its run (PREV is -1), giving
+   the record to the entry before it, at PREV.  Marking it free
+   first means that a dir_readdir() position saved at OFS never
+   returns the removed name.  Returns the offset of the entry that
+   gained room, or -1 on failure. */
+static off_t
+drop_entry (struct inode *inode, off_t ofs, struct dir_entry *e, off_t prev)
+{
+  struct dir_entry p;
+
+  e->name_len = 0;
+  if (!write_entry (inode, ofs, e))
+    return -1;
+  if (prev < 0)
+    return ofs;
+  if (!read_entry (inode, prev, &p)
+      || !write_rec_len (inode, prev, p.rec_len + e->rec_len))
+    return -1;
+  return prev;
+}
+
+/* Reads the index block of the directory in INODE into *IDX.
+   Returns true if the directory is indexed, false if it is still
+   a linear run of entries. */
+static bool
+read_index (struct inode *inode, struct dir_index *idx)
+{
+  return (inode_read_at (inode, idx, sizeof *idx, 0) == sizeof *idx
+          && idx->magic == DIR_INDEX_MAGIC);
+}
+
+/* Returns the offset of the first entry in bucket block BLOCK. */
+static off_t
+bucket_start (size_t block)
+{
+  return block * BLOCK_SECTOR_SIZE + sizeof (struct dir_bucket);
+}
+
+/* Returns the offset just past bucket block BLOCK. */
+static off_t
+bucket_end (size_t block)
+{
+  return (block + 1) * BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket block that names hashing to HASH belong in. */
+static uint16_t
+index_bucket (const struct dir_index *idx, unsigned hash)
+{
+  return idx->table[hash & ((1u << idx->depth) - 1)];
+}
+
+/* Starts an empty bucket image with local depth DEPTH in IMG. */
+static void
+image_init (struct bucket_image *img, uint16_t depth)
+{
+  struct dir_bucket b;
+
+  memset (img->data, 0, sizeof img->data);
+  b.depth = depth;
+  b.next = 0;
+  memcpy (img->data, &b, sizeof b);
+  img->end = sizeof b;
+  img->last = 0;
+}
+
+/* Appends a copy of *E to IMG. */
+static void
+image_add (struct bucket_image *img, const struct dir_entry *e)
+{
+  struct dir_entry copy = *e;
+
+  copy.rec_len = ENTRY_SIZE (e->name_len);
+  ASSERT (img->end + copy.rec_len <= BLOCK_SECTOR_SIZE);
+  memcpy (img->data + img->end, &copy, copy.rec_len);
+  img->last = img->end;
+  img->end += copy.rec_len;
+}
+
+/* Hands the unused end of IMG to its last entry, or to a free
+   record if it has none, so that its entries fill the block. */
+static void
+image_finish (struct bucket_image *img)
+{
+  struct dir_entry e;
+
+  if (img->last == 0)
+    {
+      memset (&e, 0, sizeof e);
+      e.rec_len = BLOCK_SECTOR_SIZE - img->end;
+      memcpy (img->data + img->end, &e, ENTRY_SIZE (0));
+    }
+  else
+    {
+      memcpy (&e, img->data + img->last, ENTRY_SIZE (0));
+      e.rec_len += BLOCK_SECTOR_SIZE - img->end;
+      memcpy (img->data + img->last, &e, ENTRY_SIZE (0));
+    }
+}
+
+/* Writes IMG to bucket block BLOCK of INODE.
+   Returns true if successful, false on failure. */
+static bool
+image_write (struct inode *inode, size_t block, struct bucket_image *img)
+{
+  image_finish (img);
+  return inode_write_at (inode, img->data, BLOCK_SECTOR_SIZE,
+                         block * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Writes an empty bucket with local depth DEPTH to BLOCK of
+   INODE.  Returns true if successful, false on failure. */
+static bool
+bucket_init (struct inode *inode, size_t block, uint16_t depth)
+{
+  struct bucket_image *img = malloc (sizeof *img);
+  bool success;
+
+  if (img == NULL)
+    return false;
+  image_init (img, depth);
+  success = image_write (inode, block, img);
+  free (img);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   if EP is non-null, sets *OFSP to the byte offset of the
+   directory entry if OFSP is non-null, and sets *PREVP to the
+   offset of the entry before it, as for find_entry(), if PREVP
+   is non-null.
+   otherwise, returns false and ignores EP, OFSP and PREVP.
+   DIR's lock must be held. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+        struct dir_entry *ep, off_t *ofsp, off_t *prevp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_index idx;
+  struct dir_bucket b;
+  size_t block;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
+  if (!read_index (dir->inode, &idx))
+    return find_entry (dir->inode, 0, inode_length (dir->inode), name,
+                       ep, ofsp, prevp);
+
+  /* Only NAME's bucket and its overflow chain can hold it. */
+  for (block = index_bucket (&idx, hash_string (name)); block != 0;
+       block = b.next)
+    {
+      if (find_entry (dir->inode, bucket_start (block), bucket_end (block),
+                      name, ep, ofsp, prevp))
         return true;
-      }
+      if (inode_read_at (dir->inode, &b, sizeof b,
+                         block * BLOCK_SECTOR_SIZE) != sizeof b)
+        break;
+    }
   return false;
 }
 
+/* Splits bucket BLOCK of the indexed directory in INODE, whose
+   index block is *IDX, on the next bit of the name hash, moving
+   the entries with that bit set into a new bucket.  Doubles the
+   table first if BLOCK already uses all of its bits.
+   Returns true if successful, false on failure. */
+static bool
+index_split (struct inode *inode, struct dir_index *idx, uint16_t block)
+{
+  struct bucket_image *imgs;
+  struct dir_bucket b;
+  struct dir_entry e;
+  uint16_t new_block;
+  unsigned bit;
+  off_t ofs;
+  size_t i;
+  bool success = false;
+
+  if (inode_read_at (inode, &b, sizeof b, block * BLOCK_SECTOR_SIZE)
+      != sizeof b || idx->block_cnt == UINT16_MAX)
+    return false;
+  ASSERT (b.depth < DIR_MAX_DEPTH && b.next == 0);
+  imgs = malloc (2 * sizeof *imgs);
+  if (imgs == NULL)
+    return false;
+
+  if (b.depth == idx->depth)
+    {
+      for (i = 0; i < (1u << idx->depth); i++)
+        idx->table[i + (1u << idx->depth)] = idx->table[i];
+      idx->depth++;
+    }
+
+  /* Rebuild BLOCK from the entries that stay, and the new
+     bucket from those that move, both packed from the start. */
+  new_block = idx->block_cnt++;
+  bit = 1u << b.depth;
+  image_init (&imgs[0], b.depth + 1);
+  image_init (&imgs[1], b.depth + 1);
+  for (ofs = bucket_start (block);
+       ofs < bucket_end (block) && read_entry (inode, ofs, &e);
+       ofs += e.rec_len)
+    if (e.name_len != 0)
+      image_add (&imgs[(hash_string (e.name) & bit) != 0], &e);
+  if (!image_write (inode, new_block, &imgs[1])
+      || !image_write (inode, block, &imgs[0]))
+    goto done;
+
+  for (i = 0; i < (1u << idx->depth); i++)
+    if (idx->table[i] == block && (i & bit))
+      idx->table[i] = new_block;
+  success = inode_write_at (inode, idx, sizeof *idx, 0) == sizeof *idx;
+
+ done:
+  free (imgs);
+  return success;
+}
+
+/* Adds *EP to the indexed directory in INODE, whose index block
+   is *IDX, splitting its bucket or chaining an overflow block
+   onto it if it is full.
+   Returns true if successful, false on failure. */
+static bool
+index_insert (struct inode *inode, struct dir_index *idx,
+              struct dir_entry *ep)
+{
+  unsigned hash = hash_string (ep->name);
+  size_t size = ENTRY_SIZE (ep->name_len);
+
+  for (;;)
+    {
+      uint16_t head = index_bucket (idx, hash);
+      uint16_t block = head, last;
+      struct dir_bucket b;
+      struct dir_entry e;
+      off_t ofs;
+
+      /* Take the first room in the bucket's chain. */
+      do
+        {
+          if (find_room (inode, bucket_start (block), bucket_end (block),
+                         size, &e, &ofs, NULL))
+            return put_entry (inode, ofs, &e, ep);
+          if (inode_read_at (inode, &b, sizeof b, block * BLOCK_SECTOR_SIZE)
+              != sizeof b)
+            return false;
+          last = block;
+          block = b.next;
+        }
+      while (block != 0);
+
+      if (inode_read_at (inode, &b, sizeof b, head * BLOCK_SECTOR_SIZE)
+          != sizeof b)
+        return false;
+      if (b.depth < DIR_MAX_DEPTH)
+        {
+          /* Split and try again: the entry's half may still be
+             full if every name in it shares the next bit. */
+          if (!index_split (inode, idx, head))
+            return false;
+          continue;
+        }
+
+      /* Out of hash bits.  Chain an overflow block and try
+         again. */
+      if (idx->block_cnt == UINT16_MAX)
+        return false;
+      block = idx->block_cnt++;
+      if (!bucket_init (inode, block, b.depth)
+          || inode_read_at (inode, &b, sizeof b, last * BLOCK_SECTOR_SIZE)
+             != sizeof b)
+        return false;
+      b.next = block;
+      if (inode_write_at (inode, &b, sizeof b, last * BLOCK_SECTOR_SIZE)
+          != sizeof b
+          || inode_write_at (inode, idx, sizeof *idx, 0) != sizeof *idx)
+        return false;
+    }
+}
+
+/* Converts the linear directory in INODE, whose entries take
+   LENGTH bytes, to an indexed directory and stores its new index
+   block in *IDX.  Returns true if successful, false on failure. */
+static bool
+index_create (struct inode *inode, off_t length, struct dir_index *idx)
+{
+  struct dir_entry *entries, e;
+  size_t cnt, i;
+  off_t ofs;
+  bool success = false;
+
+  entries = malloc ((length / ENTRY_SIZE (1) + 1) * sizeof *entries);
+  if (entries == NULL)
+    return false;
+  cnt = 0;
+  for (ofs = 0; ofs < length && read_entry (inode, ofs, &e); ofs += e.rec_len)
+    if (e.name_len != 0)
+      entries[cnt++] = e;
+
+  /* Start with a single bucket and let it split as the old
+     entries are put back. */
+  memset (idx, 0, sizeof *idx);
+  idx->magic = DIR_INDEX_MAGIC;
+  idx->depth = 0;
+  idx->block_cnt = 2;
+  idx->table[0] = 1;
+  if (!bucket_init (inode, 1, 0)
+      || inode_write_at (inode, idx, sizeof *idx, 0) != sizeof *idx)
+    goto done;
+
+  for (i = 0; i < cnt; i++)
+    if (!index_insert (inode, idx, &entries[i]))
+      goto done;
+  success = true;
+
+ done:
+  free (entries);
+  return success;
+}
+
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
@@ -121,15 +882,32 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t parent, sector;
   struct dir_entry e;
+  unsigned gen;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  *inode = NULL;
+  if (strlen (name) > NAME_MAX)
+    return false;
+
+  parent = inode_get_inumber (dir->inode);
+  rw_lock_read_acquire (inode_dir_lock (dir->inode));
+  if (dentry_get (parent, name, &sector, &gen))
+    {
+      if (sector != DENTRY_NEGATIVE)
+        *inode = inode_open (sector);
+    }
+  else if (lookup (dir, name, &e, NULL, NULL))
+    {
+      dentry_fill (parent, name, e.inode_sector, gen);
+      *inode = inode_open (e.inode_sector);
+    }
   else
-    *inode = NULL;
+    dentry_fill (parent, name, DENTRY_NEGATIVE, gen);
+  rw_lock_read_release (inode_dir_lock (dir->inode));
 
   return *inode != NULL;
 }
@@ -143,8 +921,11 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
+  block_sector_t sector;
+  struct dir_index idx;
+  struct dir_entry e, new;
+  off_t length, ofs, first;
+  size_t size;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -154,29 +935,50 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
 
+  sector = inode_get_inumber (dir->inode);
+  rw_lock_write_acquire (inode_dir_lock (dir->inode));
+
   /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  if (lookup (dir, name, NULL, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
-
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  new.inode_sector = inode_sector;
+  new.name_len = strlen (name);
+  strlcpy (new.name, name, sizeof new.name);
+  size = ENTRY_SIZE (new.name_len);
+
+  if (read_index (dir->inode, &idx))
+    {
+      success = index_insert (dir->inode, &idx, &new);
+      goto done;
+    }
+
+  /* Use the first room big enough for the new entry, if any.
+     Otherwise append the entry at end-of-file, unless that would
+     make the directory big enough to index. */
+  length = inode_length (dir->inode);
+  if (find_room (dir->inode, hint_get (sector), length, size,
+                 &e, &ofs, &first))
+    success = put_entry (dir->inode, ofs, &e, &new);
+  else if (length + size <= DIR_LINEAR_MAX)
+    {
+      new.rec_len = size;
+      success = write_entry (dir->inode, length, &new);
+    }
+  else
+    {
+      hint_forget (sector);
+      success = (index_create (dir->inode, length, &idx)
+                 && index_insert (dir->inode, &idx, &new));
+      goto done;
+    }
+  if (success)
+    hint_set (sector, first);
 
  done:
+  if (success)
+    dentry_set (sector, name, inode_sector);
+  rw_lock_write_release (inode_dir_lock (dir->inode));
   return success;
 }
 
@@ -186,10 +988,11 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  block_sector_t sector;
   struct dir_entry e;
   struct inode *inode = NULL;
   bool success = false;
-  off_t ofs;
+  off_t ofs, prev, gained;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
@@ -197,8 +1000,12 @@ dir_remove (struct dir *dir, const char *name)
   //added4-7 
   if(!strcmp(name, ".") ||!strcmp(name,".."))
    return false;
+
+  sector = inode_get_inumber (dir->inode);
+  rw_lock_write_acquire (inode_dir_lock (dir->inode));
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e, &ofs, &prev))
     goto done;
 
   /* Open inode. */
@@ -207,37 +1014,115 @@ dir_remove (struct dir *dir, const char *name)
     goto done;
 
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  gained = drop_entry (dir->inode, ofs, &e, prev);
+  if (gained < 0)
     goto done;
+  hint_lower (sector, gained);
+  dentry_set (sector, name, DENTRY_NEGATIVE);
+  if (is_directory (inode))
+    dentry_purge (e.inode_sector);
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  rw_lock_write_release (inode_dir_lock (dir->inode));
   inode_close (inode);
   return success;
 }
 
+/* Returns POS, a position in the run of entries from START to END
+   in INODE, moved forward to the first entry at or after it.  A
+   position saved by dir_tell() may have ended up inside a record
+   since, if the entry there was removed and its space given to a
+   new one. */
+static off_t
+align_pos (struct inode *inode, off_t start, off_t end, off_t pos)
+{
+  struct dir_entry e;
+  off_t ofs;
+
+  for (ofs = start; ofs < pos && ofs < end && read_entry (inode, ofs, &e);
+       ofs += e.rec_len)
+    continue;
+  return ofs < pos ? end : ofs;
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
+   contains no more entries.
+   Names added or removed since DIR was opened may or may not be
+   returned, but a name is never returned after dir_remove() of it
+   returns, and the other names are each returned once, as long as
+   the directory is not indexed (index_create()) and none of its
+   buckets split (index_split()) in the meantime.  Those move
+   entries around, so a listing in progress across one may return
+   some names twice or miss some. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  struct dir_index idx;
   struct dir_entry e;
+  bool indexed, found = false;
+  off_t end;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
+  rw_lock_read_acquire (inode_dir_lock (dir->inode));
+  indexed = read_index (dir->inode, &idx);
+  end = (indexed ? (off_t) idx.block_cnt * BLOCK_SECTOR_SIZE
+         : inode_length (dir->inode));
+  /* Entries may have moved since DIR's position was saved. */
+  if (!indexed)
+    dir->pos = align_pos (dir->inode, 0, end, dir->pos);
+  else if (dir->pos >= BLOCK_SECTOR_SIZE && dir->pos < end)
     {
-      dir->pos += sizeof e;
+      size_t block = dir->pos / BLOCK_SECTOR_SIZE;
+      dir->pos = align_pos (dir->inode, bucket_start (block),
+                            bucket_end (block), dir->pos);
+    }
+  while (!found)
+    {
+      if (indexed)
+        {
+          /* Walk the bucket blocks in order, skipping block 0
+             and the header at the start of each bucket. */
+          size_t block = dir->pos / BLOCK_SECTOR_SIZE;
+          if (block == 0)
+            dir->pos = bucket_start (1);
+          else if (dir->pos < bucket_start (block))
+            dir->pos = bucket_start (block);
+        }
+      if (dir->pos >= end || !read_entry (dir->inode, dir->pos, &e))
+        break;
+
+      dir->pos += e.rec_len;
       //added4 3-7
       //if entry name is not . and .. , copy the name
-      if (e.in_use && strcmp(e.name,".") && strcmp(e.name,".."))
+      if (e.name_len != 0 && strcmp(e.name,".") && strcmp(e.name,".."))
         {
           strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          found = true;
         } 
     }
-  return false;
+  rw_lock_read_release (inode_dir_lock (dir->inode));
+  return found;
+}
+
+/* Sets the position in DIR from which dir_readdir() continues to
+   POS, a value returned by dir_tell(). */
+void
+dir_seek (struct dir *dir, off_t pos)
+{
+  ASSERT (dir != NULL);
+  ASSERT (pos >= 0);
+  dir->pos = pos;
+}
+
+/* Returns the position in DIR from which dir_readdir() continues,
+   the offset of an entry rather than a count of names. */
+off_t
+dir_tell (const struct dir *dir)
+{
+  ASSERT (dir != NULL);
+  return dir->pos;
 }
@@ -25,14 +25,18 @@ filesys_init (bool format)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dir_init ();
   free_map_init ();
   buffer_cache_init();
 
 
   if (format) 
     do_format ();
+  else
+    inode_format = inode_get_format (ROOT_DIR_SECTOR);
 
   free_map_open ();
+  cache_write_behind_init ();
 
   //added4 3-2
   //set current directory by root directory
@@ -44,7 +48,9 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_allocate_all ();
   free_map_close ();
+  cache_flush_all ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -62,7 +68,9 @@ filesys_create (const char *name, off_t initial_size)
 
   //struct dir *dir = dir_open_root ();
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (
+                       inode_get_inumber (dir_get_inode (dir)), 1,
+                       &inode_sector)
                   //added4 3-1
                   //set flag 0
                   && inode_create (inode_sector, initial_size,0)
@@ -139,9 +147,10 @@ filesys_remove (const char *name)
 static void
 do_format (void)
 {
-  printf ("Formatting file system...");
+  printf ("Formatting file system (%s inodes)...",
+          inode_format == INODE_EXTENT ? "extent" : "indexed");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
 
   //added4
@@ -1,12 +1,140 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <stdio.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Sectors per allocation group. */
+#define GROUP_SECTORS 512
+
+/* An allocation group: GROUP_SECTORS consecutive sectors of the
+   disk, the last group possibly fewer. */
+struct alloc_group
+  {
+    size_t free_cnt;                 /* Number of free sectors. */
+    block_sector_t hint;             /* No free sector below this. */
+  };
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static size_t free_cnt;              /* Number of free sectors. */
+static size_t reserved_cnt;          /* Free sectors set aside. */
+static struct alloc_group *groups;   /* Allocation groups. */
+static size_t group_cnt;             /* Number of allocation groups. */
+static block_sector_t next_goal;     /* Where free_map_allocate() looks. */
+static struct lock free_map_lock;    /* Protects the above. */
+
+/* Statistics. */
+static long long update_cnt;         /* Allocations and releases. */
+static long long write_bytes;        /* Free map bytes written for them. */
+
+/* Writes the part of the free map that holds the bits for CNT
+   sectors starting at SECTOR back to the free map file, if it is
+   open, through the buffer cache.  Returns false if that fails. */
+static bool
+write_bits (block_sector_t sector, size_t cnt) 
+{
+  off_t size;
+
+  if (free_map_file == NULL)
+    return true;
+  size = bitmap_write_range (free_map, free_map_file, sector, cnt);
+  if (size < 0)
+    return false;
+  update_cnt++;
+  write_bytes += size;
+  return true;
+}
+
+/* Recounts the free sectors, overall and in each group, from the
+   free map. */
+static void
+count_free (void) 
+{
+  size_t i;
+
+  free_cnt = bitmap_count (free_map, 0, bitmap_size (free_map), false);
+  for (i = 0; i < group_cnt; i++)
+    {
+      block_sector_t start = i * GROUP_SECTORS;
+      size_t cnt = bitmap_size (free_map) - start;
+
+      if (cnt > GROUP_SECTORS)
+        cnt = GROUP_SECTORS;
+      groups[i].free_cnt = bitmap_count (free_map, start, cnt, false);
+      groups[i].hint = start;
+    }
+}
+
+/* Updates the groups for CNT sectors starting at SECTOR having
+   just been allocated, if ALLOCATED is true, or released. */
+static void
+update_groups (block_sector_t sector, size_t cnt, bool allocated) 
+{
+  while (cnt > 0)
+    {
+      struct alloc_group *g = &groups[sector / GROUP_SECTORS];
+      size_t part = GROUP_SECTORS - sector % GROUP_SECTORS;
+
+      if (part > cnt)
+        part = cnt;
+      if (allocated)
+        {
+          g->free_cnt -= part;
+          if (g->hint == sector)
+            g->hint = sector + part;
+        }
+      else
+        {
+          g->free_cnt += part;
+          if (g->hint > sector)
+            g->hint = sector;
+        }
+      sector += part;
+      cnt -= part;
+    }
+}
+
+/* Returns the first sector of the first run of CNT free sectors at
+   or after START, or BITMAP_ERROR if there is none.  Goes one group
+   at a time, skipping groups with too few free sectors unless a run
+   could start there and spill over into the next group, and scans
+   each of the others only from its hint to its end, plus however
+   far a run starting there extends. */
+static block_sector_t
+scan_from (block_sector_t start, size_t cnt) 
+{
+  size_t i;
+
+  for (i = start / GROUP_SECTORS; i < group_cnt; i++)
+    {
+      block_sector_t group_start = i * GROUP_SECTORS;
+      block_sector_t group_end = group_start + GROUP_SECTORS;
+      block_sector_t from = start > group_start ? start : group_start;
+      block_sector_t sector;
+
+      if (group_end > bitmap_size (free_map))
+        group_end = bitmap_size (free_map);
+      if (groups[i].free_cnt == 0)
+        continue;
+      if (groups[i].free_cnt < cnt
+          && (i + 1 == group_cnt || bitmap_test (free_map, group_end - 1)))
+        continue;
+      if (from < groups[i].hint)
+        from = groups[i].hint;
+      if (from >= group_end)
+        continue;
+      sector = bitmap_scan_range (free_map, from, group_end, cnt, false);
+      if (sector != BITMAP_ERROR)
+        return sector;
+    }
+  return BITMAP_ERROR;
+}
 
 /* Initializes the free map. */
 void
@@ -17,36 +145,146 @@ free_map_init (void)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  group_cnt = DIV_ROUND_UP (bitmap_size (free_map), GROUP_SECTORS);
+  groups = malloc (group_cnt * sizeof *groups);
+  if (groups == NULL)
+    PANIC ("allocation group creation failed");
+  lock_init (&free_map_lock);
+  count_free ();
+  reserved_cnt = 0;
+  next_goal = 0;
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.  Sectors set aside by free_map_reserve() are not
+   handed out.
+   Callers with no better goal get the sectors just past those
+   handed out by the previous call, rather than the first free
+   ones on the disk, so that they do not all pile up scanning the
+   front of the free map. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t goal;
+
+  lock_acquire (&free_map_lock);
+  goal = next_goal;
+  lock_release (&free_map_lock);
+
+  if (!free_map_allocate_near (goal, cnt, sectorp))
+    return false;
+
+  lock_acquire (&free_map_lock);
+  next_goal = *sectorp + cnt;
+  lock_release (&free_map_lock);
+  return true;
+}
+
+/* Allocates CNT consecutive sectors at or after GOAL, wrapping
+   around to the start of the disk if there is no such run, and
+   stores the first into *SECTORP.  If RESERVED is true, the
+   sectors come out of those set aside by free_map_reserve() and
+   are no longer set aside afterward; otherwise they come out of
+   the rest.  Returns true if successful. */
+static bool
+allocate (block_sector_t goal, size_t cnt, block_sector_t *sectorp,
+          bool reserved)
+{
+  block_sector_t sector = BITMAP_ERROR;
+  size_t avail;
+
+  lock_acquire (&free_map_lock);
+  if (goal >= bitmap_size (free_map))
+    goal = 0;
+  avail = reserved ? reserved_cnt : free_cnt - reserved_cnt;
+  if (cnt <= avail)
+    {
+      sector = scan_from (goal, cnt);
+      if (sector == BITMAP_ERROR && goal > 0)
+        sector = scan_from (0, cnt);
+      if (sector != BITMAP_ERROR)
+        bitmap_set_multiple (free_map, sector, cnt, true);
+    }
+  if (sector != BITMAP_ERROR && !write_bits (sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      *sectorp = sector;
+      free_cnt -= cnt;
+      if (reserved)
+        reserved_cnt -= cnt;
+      update_groups (sector, cnt, true);
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Like free_map_allocate(), but takes the first run of CNT free
+   sectors at or after GOAL, wrapping around to the start of the
+   disk if there is none, so that related data stays close. */
+bool
+free_map_allocate_near (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  return allocate (goal, cnt, sectorp, false);
+}
+
+/* Like free_map_allocate_near(), but takes the sectors out of
+   those the caller set aside with free_map_reserve(), which must
+   number at least CNT, so that only a lack of CNT consecutive free
+   sectors (or a failure to write the free map) can stop it.  The
+   sectors allocated are no longer set aside. */
+bool
+free_map_allocate_reserved (block_sector_t goal, size_t cnt,
+                            block_sector_t *sectorp)
+{
+  return allocate (goal, cnt, sectorp, true);
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  write_bits (sector, cnt);
+  free_cnt += cnt;
+  update_groups (sector, cnt, false);
+  lock_release (&free_map_lock);
+}
+
+/* Sets aside CNT free sectors, without choosing which, so that
+   later calls to free_map_allocate_reserved() find room for them.
+   Returns false if fewer than CNT free sectors remain
+   that are not already set aside. */
+bool
+free_map_reserve (size_t cnt)
+{
+  bool success;
+
+  lock_acquire (&free_map_lock);
+  success = cnt <= free_cnt - reserved_cnt;
+  if (success)
+    reserved_cnt += cnt;
+  lock_release (&free_map_lock);
+  return success;
+}
+
+/* Returns CNT sectors set aside by free_map_reserve(). */
+void
+free_map_unreserve (size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (cnt <= reserved_cnt);
+  reserved_cnt -= cnt;
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,6 +296,7 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  count_free ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -72,16 +311,33 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
   //added4 3-1
   //set flag 0
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map),0))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The file starts out as a hole, so the
+     first write allocates its sectors; free_map_file stays null
+     until then so that allocating them does not write the free
+     map back into the file being filled. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
+  if (!bitmap_write (free_map, file))
+    PANIC ("can't write free map");
+  free_map_file = file;
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
 }
+
+/* Prints free map statistics. */
+void
+free_map_print_stats (void) 
+{
+  printf ("Free map: %lld updates, %lld bytes written, %lld per update\n",
+          update_cnt, write_bytes,
+          update_cnt > 0 ? write_bytes / update_cnt : 0);
+}
@@ -7,6 +7,7 @@
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -75,11 +76,13 @@ fsutil_extract (char **argv UNUSED)
   static block_sector_t sector = 0;
 
   struct block *src;
-  void *header, *data;
+  void *header;
+  uint8_t *data;
 
-  /* Allocate buffers. */
+  /* Allocate buffers.  DATA holds two sectors, so that one can be
+     read while the other is written. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (2 * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -114,6 +117,8 @@ fsutil_extract (char **argv UNUSED)
       else if (type == USTAR_REGULAR)
         {
           struct file *dst;
+          struct block_request req;
+          int i;
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
@@ -124,14 +129,29 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
-          while (size > 0)
+          /* Do copy.  While one sector is being written into the
+             file system, the next is already being read from the
+             scratch device, which is normally on the other IDE
+             channel. */
+          if (size > 0)
             {
+              block_request_init (&req, sector++, 1, data, false);
+              block_submit (src, &req);
+            }
+          for (i = 0; size > 0; i = !i)
+            {
+              uint8_t *cur = data + i * BLOCK_SECTOR_SIZE;
               int chunk_size = (size > BLOCK_SECTOR_SIZE
                                 ? BLOCK_SECTOR_SIZE
                                 : size);
-              block_read (src, sector++, data);
-              if (file_write (dst, data, chunk_size) != chunk_size)
+              block_wait (&req);
+              if (size > chunk_size)
+                {
+                  block_request_init (&req, sector++, 1,
+                                      data + !i * BLOCK_SECTOR_SIZE, false);
+                  block_submit (src, &req);
+                }
+              if (file_write (dst, cur, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
               size -= chunk_size;
@@ -221,3 +241,19 @@ fsutil_append (char **argv)
   file_close (src);
   free (buffer);
 }
+
+/* Prints how many extents, runs of consecutive disk sectors, file
+   ARGV[1] is stored in, as a measure of its fragmentation. */
+void
+fsutil_extents (char **argv)
+{
+  const char *file_name = argv[1];
+  struct file *file;
+
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+  printf ("'%s': %"PROTd" bytes in %zu extents\n", file_name,
+          file_length (file), inode_extent_count (file_get_inode (file)));
+  file_close (file);
+}
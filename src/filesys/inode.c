@@ -1,4 +1,5 @@
 #include "filesys/inode.h"
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
@@ -6,35 +7,121 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 #include "filesys/buffer_cache.h"
 
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
+/* Identifies an inode, and which of the two data mappings it
+   uses.  An inode whose data is small enough is kept inline, in
+   the inode itself, until it grows; its magic number says which
+   mapping it then switches to. */
+#define INODE_MAGIC 0x494e4f44          /* Direct/indirect maps. */
+#define EXTENT_MAGIC 0x494e4f45         /* Extent list. */
+#define INLINE_MAGIC 0x494e4f4c         /* Inline, then INODE_MAGIC. */
+#define INLINE_EXTENT_MAGIC 0x494e4f4d  /* Inline, then EXTENT_MAGIC. */
 //added4 2-1
 //# of direct block entriy is 123
 #define DIRECT_BLOCK_ENTRIES 123
 //# of indirect index block
 #define INDIRECT_BLOCK_ENTRIES (BLOCK_SECTOR_SIZE / sizeof(block_sector_t))
 
+/* Largest file size in sectors: everything the direct, indirect
+   and double indirect maps can address. */
+#define MAX_FILE_SECTORS (DIRECT_BLOCK_ENTRIES + INDIRECT_BLOCK_ENTRIES \
+                          + INDIRECT_BLOCK_ENTRIES * INDIRECT_BLOCK_ENTRIES)
+
+/* Map entry for a sector that has not been allocated, a hole that
+   reads as zeros.  Sector 0 holds the free map inode, so it is
+   never a file's data or index block, and a zeroed index block
+   maps nothing. */
+#define NO_SECTOR ((block_sector_t) 0)
+
+/* What byte_to_sector() returns for a hole or past end of file. */
+#define HOLE ((block_sector_t) -1)
+
+/* Number of closed inodes kept in memory for reopening. */
+#define CLOSED_INODES_MAX 16
+
+/* How far inode_read_ahead() reads ahead, in sectors. */
+#define READ_AHEAD_SECTORS 4
+
+/* A run of LENGTH file sectors starting at file sector LOGICAL,
+   stored in consecutive disk sectors starting at PHYSICAL. */
+struct extent
+  {
+    uint32_t logical;                   /* First file sector. */
+    block_sector_t physical;            /* First disk sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
+/* Bytes of data an inline inode can hold: everything after the
+   header fields. */
+#define INLINE_DATA_SIZE 500
+
+/* Extents kept in the inode itself and in its overflow sector. */
+#define INLINE_EXTENTS 41
+#define OVERFLOW_EXTENTS (BLOCK_SECTOR_SIZE / sizeof (struct extent))
+
+/* Extents remembered by an open inode. */
+#define EXTENT_CACHE_SIZE 4
+
+/* Direct map entries kept in an open inode. */
+#define HOT_DIRECT_ENTRIES 8
+
+/* File sectors FIRST...FIRST+CNT-1 of an open inode, not yet given
+   disk sectors: what has been written to them is cached under
+   placeholder sectors BASE...BASE+CNT-1, and RESERVED free sectors
+   are set aside to allocate them and any index blocks they need. */
+struct delayed_run
+  {
+    size_t first;                       /* First file sector. */
+    size_t cnt;                         /* Number of sectors. */
+    block_sector_t base;                /* First placeholder sector. */
+    size_t reserved;                    /* Sectors reserved for them. */
+  };
+
 /* On-disk inode.
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-   block_sector_t start;               /* First data sector. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
-   uint32_t unused[124];               /* Not used. */
 
-  //added4 2-1
-  //  block_sector_t direct_map_table[DIRECT_BLOCK_ENTRIES];
-  //  block_Sector_t indirect_block_sec;
-  //  blokc_sector_t double_indirect_block_sec;
-    
   //added4 3-1
   //flag indicating if it's file or directory
     int is_dir;
+
+    union
+      {
+        /* INODE_MAGIC. */
+        struct
+          {
+  //added4 2-1
+            block_sector_t direct_map_table[DIRECT_BLOCK_ENTRIES];
+            block_sector_t indirect_block_sec;
+            block_sector_t double_indirect_block_sec;
+          };
+
+        /* EXTENT_MAGIC: extents in file order, covering every
+           allocated sector; file sectors between them are holes.
+           Extents past INLINE_EXTENTS are in the overflow
+           sector. */
+        struct
+          {
+            uint32_t extent_cnt;
+            block_sector_t overflow_sec;
+            struct extent extents[INLINE_EXTENTS];
+          };
+
+        /* INLINE_MAGIC and INLINE_EXTENT_MAGIC: the file's data,
+           zeros past its length. */
+        uint8_t data[INLINE_DATA_SIZE];
+      };
   };
 
+/* Inode format used for new inodes.  Chosen with "-f=FORMAT" when
+   formatting; otherwise that of the root directory. */
+enum inode_format inode_format = INODE_INDEXED;
+
 //added4
 //the way inode indicates block
 enum direct_t{
@@ -54,12 +141,19 @@ struct sector_location{
 };
 
 //map table which indirect block has
-/*struct inode_indirect_block{
+struct inode_indirect_block{
 
-  struct block_sector_t block_table[INDIRECT_BLOCK_ENTRIES];
+  block_sector_t map_table[INDIRECT_BLOCK_ENTRIES];
 };
 
-*/
+/* Returns true if an inode with magic number MAGIC keeps its
+   data inline. */
+static inline bool
+is_inline (unsigned magic)
+{
+  return magic == INLINE_MAGIC || magic == INLINE_EXTENT_MAGIC;
+}
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -71,48 +165,935 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct hash_elem elem;              /* Element in open_inodes. */
+    struct list_elem closed_elem;       /* Element in closed_inodes. */
     block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers, 0 if closed. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-   struct inode_disk data;             /* Inode content. */
+
+    /* The fields of the disk inode that are used on every access.
+       The rest of it is read and written through the buffer cache
+       as needed. */
+    off_t length;                       /* File size in bytes. */
+    unsigned magic;                     /* Magic number. */
+    bool is_dir;                        /* Directory or file? */
+    block_sector_t direct[HOT_DIRECT_ENTRIES]; /* INODE_MAGIC only. */
+
+    /* Recently used extents, for EXTENT_MAGIC inodes.  A cached
+       extent may be shorter than the one on disk, which only ever
+       grows at the end, but is never wrong. */
+    struct extent ext_cache[EXTENT_CACHE_SIZE];
+    int ext_cache_next;                 /* Next slot to replace. */
+
+    /* Sectors past the end of the allocated data, if any, that
+       are waiting for inode_allocate_delayed(). */
+    struct delayed_run delayed;
     //added for extension lock
-  //  struct lock ex_lock;
+    /* Held shared by readers and by writers that only overwrite
+       allocated sectors, exclusively by writers that extend the
+       file or fill holes and by anything else that changes the
+       length, the map or the delayed run. */
+    struct rw_lock ex_lock;
+
+    /* Byte ranges being overwritten under a shared EX_LOCK, so
+       that overlapping writes take turns. */
+    struct lock lock;                   /* Protects ranges, ext_cache. */
+    struct condition range_freed;       /* Signaled when a range ends. */
+    struct list ranges;                 /* List of struct write_range. */
+
+    /* For directories, held shared while looking names up or
+       reading entries and exclusively while adding or removing
+       them.  See inode_dir_lock(). */
+    struct rw_lock dir_lock;
+  };
+
+/* Bytes START...END-1 of an inode, being written in place. */
+struct write_range
+  {
+    struct list_elem elem;              /* Element in inode's ranges. */
+    off_t start;                        /* First byte. */
+    off_t end;                          /* One past the last byte. */
   };
 
+/* Finds where the map entry for file sector SEC lives and stores
+   it in *LOC.  LOC->direct is ERROR if SEC is past the largest
+   file size. */
+static void
+set_location (size_t sec, struct sector_location *loc)
+{
+  //direct
+  if (sec < DIRECT_BLOCK_ENTRIES)
+    {
+      loc->direct = DIRECT;
+      loc->index1 = sec;
+      return;
+    }
+  sec -= DIRECT_BLOCK_ENTRIES;
+
+  //indirect
+  if (sec < INDIRECT_BLOCK_ENTRIES)
+    {
+      loc->direct = INDIRECT;
+      loc->index1 = sec;
+      return;
+    }
+  sec -= INDIRECT_BLOCK_ENTRIES;
+
+  //double indirect
+  if (sec < INDIRECT_BLOCK_ENTRIES * INDIRECT_BLOCK_ENTRIES)
+    {
+      loc->direct = DOUBLE;
+      loc->index1 = sec / INDIRECT_BLOCK_ENTRIES;
+      loc->index2 = sec % INDIRECT_BLOCK_ENTRIES;
+      return;
+    }
+
+  //wrong offset
+  loc->direct = ERROR;
+}
+
+//convert index to byte offset
+static inline off_t 
+map_offset (int index)
+{
+  return index * sizeof (block_sector_t);
+}
+
+/* Returns entry INDEX of the index block in sector TABLE, or
+   NO_SECTOR if TABLE itself is not allocated. */
+static block_sector_t
+read_map_entry (block_sector_t table, int index)
+{
+  block_sector_t sector = NO_SECTOR;
+
+  if (table != NO_SECTOR)
+    cache_read (table, &sector, map_offset (index), sizeof sector);
+  return sector;
+}
+
+/* Offset of MEMBER in the disk inode. */
+#define DISK_OFS(MEMBER) offsetof (struct inode_disk, MEMBER)
+
+/* Returns the 32-bit field at byte offset OFS in INODE's disk
+   inode, read through the cache. */
+static uint32_t
+read_disk_field (const struct inode *inode, size_t ofs)
+{
+  uint32_t value;
+
+  cache_read (inode->sector, &value, ofs, sizeof value);
+  return value;
+}
+
+/* Returns the data sector mapped at LOC in INODE, which uses
+   direct and indirect maps, or NO_SECTOR if none is. */
+static block_sector_t
+lookup_sector (const struct inode *inode, const struct sector_location *loc)
+{
+  switch (loc->direct)
+    {
+    case DIRECT:
+      if (loc->index1 < HOT_DIRECT_ENTRIES)
+        return inode->direct[loc->index1];
+      return read_disk_field (inode, DISK_OFS (direct_map_table)
+                                     + map_offset (loc->index1));
+    case INDIRECT:
+      return read_map_entry (
+        read_disk_field (inode, DISK_OFS (indirect_block_sec)), loc->index1);
+    case DOUBLE:
+      return read_map_entry (
+        read_map_entry (
+          read_disk_field (inode, DISK_OFS (double_indirect_block_sec)),
+          loc->index1),
+        loc->index2);
+    default:
+      return NO_SECTOR;
+    }
+}
+
+/* Allocates CNT consecutive sectors as close after GOAL as it can
+   and stores the first into *SECTORP, as free_map_allocate_near()
+   does, but out of delayed run D's reservation if D is nonnull and
+   that still covers them.  Returns true if successful. */
+static bool
+allocate_near (struct delayed_run *d, block_sector_t goal, size_t cnt,
+               block_sector_t *sectorp)
+{
+  if (d == NULL || d->reserved < cnt)
+    return free_map_allocate_near (goal, cnt, sectorp);
+  if (!free_map_allocate_reserved (goal, cnt, sectorp))
+    return false;
+  d->reserved -= cnt;
+  return true;
+}
+
+/* Makes sure *TABLE names an index block, allocating a zeroed one
+   as close to sector GOAL as possible, out of delayed run D's
+   reservation as allocate_near() does, if it does not.  Returns
+   false if allocation fails. */
+static bool
+get_table (block_sector_t *table, block_sector_t goal,
+           struct delayed_run *d)
+{
+  static struct inode_indirect_block empty;
+
+  if (*table != NO_SECTOR)
+    return true;
+  if (!allocate_near (d, goal, 1, table))
+    return false;
+  cache_write (*table, &empty, 0, BLOCK_SECTOR_SIZE);
+  return true;
+}
+
+/* Records NEW_SECTOR as the data sector at LOC in DISK_INODE,
+   allocating index blocks on the way as needed, as get_table()
+   does with D.  The caller must write DISK_INODE back.  Returns
+   false if an index block could not be allocated. */
+static bool
+register_sector (struct inode_disk *disk_inode, block_sector_t new_sector,
+                 const struct sector_location *loc, struct delayed_run *d)
+{
+  block_sector_t table;
+
+  switch (loc->direct)
+    {
+    case DIRECT:
+      disk_inode->direct_map_table[loc->index1] = new_sector;
+      return true;
+
+    case INDIRECT:
+      if (!get_table (&disk_inode->indirect_block_sec, new_sector, d))
+        return false;
+      cache_write (disk_inode->indirect_block_sec, &new_sector,
+                   map_offset (loc->index1), sizeof new_sector);
+      return true;
+
+    case DOUBLE:
+      if (!get_table (&disk_inode->double_indirect_block_sec,
+                      new_sector, d))
+        return false;
+      table = read_map_entry (disk_inode->double_indirect_block_sec,
+                              loc->index1);
+      if (table == NO_SECTOR)
+        {
+          if (!get_table (&table, new_sector, d))
+            return false;
+          cache_write (disk_inode->double_indirect_block_sec, &table,
+                       map_offset (loc->index1), sizeof table);
+        }
+      cache_write (table, &new_sector, map_offset (loc->index2),
+                   sizeof new_sector);
+      return true;
+
+    default:
+      return false;
+    }
+}
+
+/* Zeros, for initializing data sectors on their first write. */
+static char zeros[BLOCK_SECTOR_SIZE];
+
+/* Gives file sector SEC, just allocated at disk sector SECTOR, the
+   data cached for it under a placeholder if it is in delayed run D
+   (which may be null).  New sectors are otherwise left as they are
+   on disk: they are only allocated to be written, and the writer
+   initializes them in the cache. */
+static void
+init_sector (const struct delayed_run *d, size_t sec, block_sector_t sector)
+{
+  if (d != NULL && sec >= d->first && sec < d->first + d->cnt)
+    cache_move (d->base + (sec - d->first), sector);
+}
+
+/* Allocates as long a run of consecutive free sectors as the free
+   map has, up to CNT, as close after GOAL as it can, out of delayed
+   run D's reservation as allocate_near() does, and stores its first
+   sector in *START.  Returns the run's length, 0 if the disk is
+   full. */
+static size_t
+allocate_run (size_t cnt, block_sector_t goal, block_sector_t *start,
+              struct delayed_run *d)
+{
+  while (cnt > 0 && !allocate_near (d, goal, cnt, start))
+    cnt /= 2;
+  return cnt;
+}
+
+/* Allocates file sectors FIRST...FIRST+CNT-1 of DISK_INODE, which
+   uses direct and indirect maps, as allocate_sectors() does. */
+static size_t
+map_allocate (struct inode_disk *disk_inode, size_t first, size_t cnt,
+              struct delayed_run *d, block_sector_t goal)
+{
+  size_t done = 0;
+
+  if (first + cnt > MAX_FILE_SECTORS)
+    cnt = first < MAX_FILE_SECTORS ? MAX_FILE_SECTORS - first : 0;
+
+  while (done < cnt)
+    {
+      block_sector_t start;
+      size_t run = allocate_run (cnt - done, goal, &start, d);
+      size_t i;
+
+      if (run == 0)
+        break;
+      goal = start + run;
+      for (i = 0; i < run; i++, done++)
+        {
+          struct sector_location loc;
+
+          set_location (first + done, &loc);
+          if (!register_sector (disk_inode, start + i, &loc, d))
+            {
+              free_map_release (start + i, run - i);
+              return done;
+            }
+          init_sector (d, first + done, start + i);
+        }
+    }
+  return done;
+}
+
+/* Releases every sector in index block TABLE, which is an index
+   block of depth LEVEL (1 means its entries are data sectors), and
+   then TABLE itself. */
+static void
+free_table (block_sector_t table, int level)
+{
+  struct inode_indirect_block block;
+  size_t i;
+
+  if (table == NO_SECTOR)
+    return;
+  cache_read (table, &block, 0, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++)
+    if (block.map_table[i] != NO_SECTOR)
+      {
+        if (level > 1)
+          free_table (block.map_table[i], level - 1);
+        else
+          free_map_release (block.map_table[i], 1);
+      }
+  free_map_release (table, 1);
+}
+
+/* Returns the number of sectors index block TABLE of depth LEVEL
+   and everything under it take up. */
+static size_t
+count_table (block_sector_t table, int level)
+{
+  struct inode_indirect_block block;
+  size_t i, cnt = 1;
+
+  if (table == NO_SECTOR)
+    return 0;
+  cache_read (table, &block, 0, BLOCK_SECTOR_SIZE);
+  for (i = 0; i < INDIRECT_BLOCK_ENTRIES; i++)
+    if (block.map_table[i] != NO_SECTOR)
+      cnt += level > 1 ? count_table (block.map_table[i], level - 1) : 1;
+  return cnt;
+}
+
+/* Releases all data and index sectors mapped by DISK_INODE, which
+   uses direct and indirect maps. */
+static void
+map_free (struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  for (i = 0; i < DIRECT_BLOCK_ENTRIES; i++)
+    if (disk_inode->direct_map_table[i] != NO_SECTOR)
+      free_map_release (disk_inode->direct_map_table[i], 1);
+  free_table (disk_inode->indirect_block_sec, 1);
+  free_table (disk_inode->double_indirect_block_sec, 2);
+}
+
+/* Returns extent number IDX of DISK_INODE, which uses an extent
+   list, in *E. */
+static void
+extent_read (const struct inode_disk *disk_inode, size_t idx,
+             struct extent *e)
+{
+  if (idx < INLINE_EXTENTS)
+    *e = disk_inode->extents[idx];
+  else
+    cache_read (disk_inode->overflow_sec, e,
+                (idx - INLINE_EXTENTS) * sizeof *e, sizeof *e);
+}
+
+/* Like extent_read(), but reads the extent from open INODE's disk
+   inode through the cache. */
+static void
+extent_fetch (const struct inode *inode, size_t idx, struct extent *e)
+{
+  if (idx < INLINE_EXTENTS)
+    cache_read (inode->sector, e, DISK_OFS (extents) + idx * sizeof *e,
+                sizeof *e);
+  else
+    cache_read (read_disk_field (inode, DISK_OFS (overflow_sec)), e,
+                (idx - INLINE_EXTENTS) * sizeof *e, sizeof *e);
+}
+
+/* Stores E as extent number IDX of DISK_INODE, which uses an
+   extent list, allocating the overflow sector if needed, as
+   get_table() does with D.  The caller must write DISK_INODE back.
+   Returns false if there is no room for extent IDX. */
+static bool
+extent_write (struct inode_disk *disk_inode, size_t idx,
+              const struct extent *e, struct delayed_run *d)
+{
+  if (idx < INLINE_EXTENTS)
+    disk_inode->extents[idx] = *e;
+  else if (idx < INLINE_EXTENTS + OVERFLOW_EXTENTS
+           && get_table (&disk_inode->overflow_sec, e->physical, d))
+    cache_write (disk_inode->overflow_sec, e,
+                 (idx - INLINE_EXTENTS) * sizeof *e, sizeof *e);
+  else
+    return false;
+  return true;
+}
+
+/* Inserts E as extent number IDX of DISK_INODE, which uses an
+   extent list, moving the extents from IDX on up by one, and
+   allocating as extent_write() does with D.  The caller must write
+   DISK_INODE back.  Returns false, changing nothing, if the list
+   is full. */
+static bool
+extent_insert (struct inode_disk *disk_inode, size_t idx,
+               const struct extent *e, struct delayed_run *d)
+{
+  size_t i;
+
+  /* The first move is into the new last slot, the only one that
+     can fail. */
+  for (i = disk_inode->extent_cnt; i > idx; i--)
+    {
+      struct extent moved;
+      extent_read (disk_inode, i - 1, &moved);
+      if (!extent_write (disk_inode, i, &moved, d))
+        return false;
+    }
+  if (!extent_write (disk_inode, idx, e, d))
+    return false;
+  disk_inode->extent_cnt++;
+  return true;
+}
+
+/* Allocates file sectors FIRST...FIRST+CNT-1 of DISK_INODE, which
+   uses an extent list, as allocate_sectors() does.  Each run is
+   merged into the extent before it when it directly follows it
+   both in the file and on disk. */
+static size_t
+extent_allocate (struct inode_disk *disk_inode, size_t first, size_t cnt,
+                 struct delayed_run *d, block_sector_t goal)
+{
+  size_t idx, done = 0;
+
+  /* Find where the new extents go: the holes lie between extents
+     IDX-1 and IDX. */
+  for (idx = 0; idx < disk_inode->extent_cnt; idx++)
+    {
+      struct extent e;
+      extent_read (disk_inode, idx, &e);
+      if (e.logical > first)
+        break;
+    }
+
+  while (done < cnt)
+    {
+      block_sector_t start;
+      size_t run = allocate_run (cnt - done, goal, &start, d);
+      struct extent prev;
+      bool merge = false;
+      size_t i;
+
+      if (run == 0)
+        break;
+      goal = start + run;
+
+      if (idx > 0)
+        {
+          extent_read (disk_inode, idx - 1, &prev);
+          merge = (prev.logical + prev.length == first + done
+                   && prev.physical + prev.length == start);
+        }
+      if (merge)
+        {
+          prev.length += run;
+          extent_write (disk_inode, idx - 1, &prev, d);
+        }
+      else
+        {
+          struct extent e;
+
+          e.logical = first + done;
+          e.physical = start;
+          e.length = run;
+          if (!extent_insert (disk_inode, idx, &e, d))
+            {
+              free_map_release (start, run);
+              break;
+            }
+          idx++;
+        }
+
+      for (i = 0; i < run; i++, done++)
+        init_sector (d, first + done, start + i);
+    }
+  return done;
+}
+
+/* Releases all data sectors and the overflow sector of DISK_INODE,
+   which uses an extent list. */
+static void
+extent_free (struct inode_disk *disk_inode)
+{
+  size_t i;
+
+  for (i = 0; i < disk_inode->extent_cnt; i++)
+    {
+      struct extent e;
+      extent_read (disk_inode, i, &e);
+      free_map_release (e.physical, e.length);
+    }
+  if (disk_inode->overflow_sec != NO_SECTOR)
+    free_map_release (disk_inode->overflow_sec, 1);
+}
+
+/* Allocates disk sectors for file sectors FIRST...FIRST+CNT-1 of
+   DISK_INODE, which must all be holes, in runs as long as the free
+   map allows, starting as close after disk sector GOAL as it can.
+   New sectors in delayed run D, if D is nonnull, take over the data
+   cached for them and, along with the index blocks they need, come
+   out of D's reservation; others are not written.  The caller must write
+   DISK_INODE back.  Returns how many of the sectors, from FIRST on,
+   were allocated: fewer than CNT if the disk fills up or the map
+   does. */
+static size_t
+allocate_sectors (struct inode_disk *disk_inode, size_t first, size_t cnt,
+                  struct delayed_run *d, block_sector_t goal)
+{
+  if (disk_inode->magic == EXTENT_MAGIC)
+    return extent_allocate (disk_inode, first, cnt, d, goal);
+  else
+    return map_allocate (disk_inode, first, cnt, d, goal);
+}
+
+/* Releases all data and index sectors of DISK_INODE. */
+static void
+free_inode_sectors (struct inode_disk *disk_inode)
+{
+  if (is_inline (disk_inode->magic))
+    return;
+  if (disk_inode->magic == EXTENT_MAGIC)
+    extent_free (disk_inode);
+  else
+    map_free (disk_inode);
+}
+
+/* Finds the run of disk sectors that holds file sector SEC of
+   INODE and stores it in *RUN.  With direct and indirect maps the
+   run is just that one sector.  Returns false if SEC is a hole. */
+static bool
+inode_map (struct inode *inode, size_t sec, struct extent *run)
+{
+  size_t i, extent_cnt;
+
+  if (inode->magic != EXTENT_MAGIC)
+    {
+      struct sector_location loc;
+
+      set_location (sec, &loc);
+      run->logical = sec;
+      run->physical = lookup_sector (inode, &loc);
+      run->length = 1;
+      return run->physical != NO_SECTOR;
+    }
+
+  lock_acquire (&inode->lock);
+  for (i = 0; i < EXTENT_CACHE_SIZE; i++)
+    {
+      const struct extent *e = &inode->ext_cache[i];
+      if (sec >= e->logical && sec < e->logical + e->length)
+        {
+          *run = *e;
+          lock_release (&inode->lock);
+          return true;
+        }
+    }
+  lock_release (&inode->lock);
+
+  /* Extents are in file order, so scan for the first one that
+     ends past SEC.  SEC is a hole unless that one starts at or
+     before SEC. */
+  extent_cnt = read_disk_field (inode, DISK_OFS (extent_cnt));
+  for (i = 0; i < extent_cnt; i++)
+    {
+      extent_fetch (inode, i, run);
+      if (sec < run->logical + run->length)
+        {
+          if (sec < run->logical)
+            return false;
+          lock_acquire (&inode->lock);
+          inode->ext_cache[inode->ext_cache_next] = *run;
+          inode->ext_cache_next = ((inode->ext_cache_next + 1)
+                                   % EXTENT_CACHE_SIZE);
+          lock_release (&inode->lock);
+          return true;
+        }
+    }
+  return false;
+}
+
+/* Reads all of INODE's disk inode into a newly allocated buffer,
+   for the operations that change its map.  Returns a null pointer
+   if memory allocation fails. */
+static struct inode_disk *
+inode_load (const struct inode *inode)
+{
+  struct inode_disk *disk_inode = malloc (sizeof *disk_inode);
+
+  if (disk_inode != NULL)
+    cache_read (inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+  return disk_inode;
+}
+
+/* Writes DISK_INODE, INODE's disk inode, back through the cache
+   and updates the map entries INODE keeps. */
+static void
+inode_save (struct inode *inode, const struct inode_disk *disk_inode)
+{
+  cache_write (inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+  memcpy (inode->direct, disk_inode->direct_map_table, sizeof inode->direct);
+}
+
+/* Writes DISK_INODE, obtained from inode_load() for INODE, back as
+   inode_save() does, and frees it. */
+static void
+inode_store (struct inode *inode, struct inode_disk *disk_inode)
+{
+  inode_save (inode, disk_inode);
+  free (disk_inode);
+}
+
+/* Returns true if file sector SEC of INODE is waiting for delayed
+   allocation. */
+static inline bool
+is_delayed (const struct inode *inode, size_t sec)
+{
+  const struct delayed_run *d = &inode->delayed;
+  return d->cnt > 0 && sec >= d->first && sec < d->first + d->cnt;
+}
+
+/* Returns the block device sector that holds file sector SEC of
+   INODE: a placeholder sector if SEC is waiting for delayed
+   allocation, HOLE if it has no sector at all. */
+static block_sector_t
+file_sector (struct inode *inode, size_t sec)
+{
+  struct extent run;
+
+  if (is_delayed (inode, sec))
+    return inode->delayed.base + (sec - inode->delayed.first);
+  if (!inode_map (inode, sec, &run))
+    return HOLE;
+  return run.physical + (sec - run.logical);
+}
+
+/* Returns where to look for a disk sector for file sector SEC of
+   INODE: right after the disk sector of file sector SEC-1, if it
+   has one, so that the file stays sequential on disk, or else
+   right after the inode. */
+static block_sector_t
+allocation_goal (struct inode *inode, size_t sec)
+{
+  block_sector_t prev = sec > 0 ? file_sector (inode, sec - 1) : HOLE;
+
+  if (prev == HOLE || prev >= CACHE_VIRTUAL_BASE)
+    return inode->sector + 1;
+  return prev + 1;
+}
+
 /* Returns the block device sector that contains byte offset POS
-   within INODE.
-   Returns -1 if INODE does not contain data for a byte at offset
+   within INODE, as file_sector() does.
+   Returns HOLE if INODE does not contain data for a byte at offset
    POS. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos) 
+byte_to_sector (struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
-//  int index = pos / BLOCK_SECTOR_SIZE;
-  int  index = pos / BLOCK_SECTOR_SIZE;
-  if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+  if (pos >= inode->length)
+    return HOLE;
+  return file_sector (inode, pos / BLOCK_SECTOR_SIZE);
+}
+
+/* Delayed allocation.  A write into holes, such as an append, only
+   reserves free space for the sectors it fills and caches their
+   data under placeholder sectors; disk sectors are chosen when the
+   data has to go to disk, all of the file's at once, so a file
+   appended to in small pieces (even in alternation with other
+   files) still ends up in long runs.  That happens when the file
+   is closed, when delayed data fills its share of the cache, or
+   at shutdown.  Only regular files other than the free map are
+   delayed.
+   Sectors are not chosen when the buffer cache flushes or evicts
+   the data, as first planned: the cache never writes back or
+   evicts a placeholder, and it has no way to call back into the
+   inode, whose EX_LOCK allocating needs.  The cache's share limit
+   above is what bounds how long data stays delayed instead. */
+
+/* Delayed sectors cached, across all inodes.  At most a quarter
+   of the cache, so that other sectors always have room. */
+static size_t delayed_total;
+
+/* Start of the next range of placeholder sectors to hand out.
+   Each inode that starts delaying gets its own range. */
+static block_sector_t next_placeholder = CACHE_VIRTUAL_BASE;
+
+/* Protects delayed_total and next_placeholder. */
+static struct lock delay_lock;
+
+/* Returns the most sectors that may be delayed at once. */
+static size_t
+delay_limit (void)
+{
+  return cache_size / 4;
+}
+
+/* Tries to give file sectors FIRST...FIRST+CNT-1 of INODE, holes
+   about to be written, placeholders instead of disk sectors by
+   adding them to its delayed run.  Returns false, changing
+   nothing, if INODE is not a regular file, if the sectors do not
+   directly follow its delayed run, if they would not fit in the
+   cache's share for delayed data or in the inode's map, or if the
+   disk is too full to reserve them.  The free map is never
+   delayed, since allocating writes it. */
+static bool
+delay_sectors (struct inode *inode, size_t first, size_t cnt)
+{
+  struct delayed_run *d = &inode->delayed;
+  size_t reserve;
+
+  if (inode->is_dir || inode->sector == FREE_MAP_SECTOR
+      || (d->cnt > 0 && first != d->first + d->cnt))
+    return false;
+  if (inode->magic == EXTENT_MAGIC
+      ? (read_disk_field (inode, DISK_OFS (extent_cnt)) + d->cnt + cnt
+         > INLINE_EXTENTS + OVERFLOW_EXTENTS)
+      : first + cnt > MAX_FILE_SECTORS)
+    return false;
+
+  /* Leave room for the index blocks the new sectors may need: an
+     index block per INDIRECT_BLOCK_ENTRIES of them, plus the
+     indirect block and the double indirect block, or the extent
+     overflow sector.  inode_allocate_delayed() relies on this. */
+  reserve = cnt + DIV_ROUND_UP (cnt, INDIRECT_BLOCK_ENTRIES) + 2;
+  if (!free_map_reserve (reserve))
+    return false;
+
+  lock_acquire (&delay_lock);
+  if (delayed_total + cnt > delay_limit ())
+    {
+      lock_release (&delay_lock);
+      free_map_unreserve (reserve);
+      return false;
+    }
+  delayed_total += cnt;
+  if (d->cnt == 0)
+    {
+      if ((block_sector_t) -1 - next_placeholder < delay_limit ())
+        next_placeholder = CACHE_VIRTUAL_BASE;
+      d->first = first;
+      d->base = next_placeholder;
+      next_placeholder += delay_limit ();
+    }
+  lock_release (&delay_lock);
+  d->cnt += cnt;
+  d->reserved += reserve;
+  return true;
+}
+
+/* Ends INODE's delayed run, if any, giving back its reservation
+   and forgetting its placeholders. */
+static void
+delay_end (struct inode *inode)
+{
+  struct delayed_run *d = &inode->delayed;
+
+  free_map_unreserve (d->reserved);
+  lock_acquire (&delay_lock);
+  delayed_total -= d->cnt;
+  lock_release (&delay_lock);
+  d->cnt = d->reserved = 0;
+}
+
+/* Disk inode for inode_allocate_delayed() to work on when memory
+   is short, so that delayed data always reaches the disk. */
+static struct inode_disk spare_disk_inode;
+static struct lock spare_lock;          /* Protects spare_disk_inode. */
+
+/* Allocates disk sectors for INODE's delayed sectors, if it has
+   any, as few runs as the free map allows, moves their cached data
+   there, and writes INODE back.  The sectors and the index blocks
+   they need come out of the run's reservation, which delay_sectors()
+   sized to cover them all, so this cannot run out of space; and the
+   map or extent list was checked to have room for every one of
+   them.  Whatever is left of the reservation is given back. */
+static void
+inode_allocate_delayed (struct inode *inode)
+{
+  struct delayed_run *d = &inode->delayed;
+  struct inode_disk *disk_inode;
+  size_t cnt;
+
+  if (d->cnt == 0)
+    return;
+
+  disk_inode = inode_load (inode);
+  if (disk_inode == NULL)
+    {
+      lock_acquire (&spare_lock);
+      disk_inode = &spare_disk_inode;
+      cache_read (inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+    }
+  cnt = allocate_sectors (disk_inode, d->first, d->cnt, d,
+                          allocation_goal (inode, d->first));
+  inode_save (inode, disk_inode);
+  if (disk_inode == &spare_disk_inode)
+    lock_release (&spare_lock);
   else
-    return -1;
+    free (disk_inode);
+  ASSERT (cnt == d->cnt);
+  delay_end (inode);
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Throws away INODE's delayed sectors, if it has any, for an inode
+   being deleted. */
+static void
+inode_discard_delayed (struct inode *inode)
+{
+  struct delayed_run *d = &inode->delayed;
+  size_t i;
+
+  for (i = 0; i < d->cnt; i++)
+    cache_discard (d->base + i);
+  delay_end (inode);
+}
+
+/* Gives file sectors FIRST...FIRST+CNT-1 of INODE, holes about to
+   be written, sectors to write to: placeholders if they can be
+   delayed, disk sectors otherwise.  Returns how many of them, from
+   FIRST on, got one. */
+static size_t
+fill_holes (struct inode *inode, size_t first, size_t cnt)
+{
+  struct inode_disk *disk_inode;
+
+  if (delay_sectors (inode, first, cnt))
+    return cnt;
+
+  /* Make room by allocating what is already delayed, then try
+     again. */
+  inode_allocate_delayed (inode);
+  if (delay_sectors (inode, first, cnt))
+    return cnt;
+
+  disk_inode = inode_load (inode);
+  if (disk_inode == NULL)
+    return 0;
+  cnt = allocate_sectors (disk_inode, first, cnt, NULL,
+                          allocation_goal (inode, first));
+  inode_store (inode, disk_inode);
+  return cnt;
+}
+
+/* Moves the data of INODE, which is inline, out to a data sector
+   and switches INODE to the mapping its magic number names, so
+   that it can grow past INLINE_DATA_SIZE bytes.  Returns false,
+   changing nothing, if memory or disk space is short. */
+static bool
+inode_promote (struct inode *inode)
+{
+  struct inode_disk *disk_inode = inode_load (inode);
+  unsigned magic;
+
+  if (disk_inode == NULL)
+    return false;
+  magic = disk_inode->magic == INLINE_EXTENT_MAGIC ? EXTENT_MAGIC : INODE_MAGIC;
+
+  /* An empty map, all holes, in place of the data. */
+  cache_write (inode->sector, zeros, DISK_OFS (data), INLINE_DATA_SIZE);
+  cache_write (inode->sector, &magic, DISK_OFS (magic), sizeof magic);
+  inode->magic = magic;
+  memset (inode->direct, 0, sizeof inode->direct);
+
+  if (inode->length > 0)
+    {
+      block_sector_t sector;
+
+      if (fill_holes (inode, 0, 1) == 0)
+        {
+          cache_write (inode->sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+          inode->magic = disk_inode->magic;
+          free (disk_inode);
+          return false;
+        }
+      sector = file_sector (inode, 0);
+      cache_write (sector, zeros, 0, BLOCK_SECTOR_SIZE);
+      cache_write (sector, disk_inode->data, 0, INLINE_DATA_SIZE);
+    }
+  free (disk_inode);
+  return true;
+}
+
+/* Open inodes, hashed by sector, so that opening a single inode
+   twice returns the same `struct inode'.  Also holds the most
+   recently closed inodes, which are on closed_inodes in the order
+   they were closed, so that reopening a hot directory or file does
+   not read its disk inode again.  Both, and every inode's
+   open_cnt, are protected by open_inodes_lock, which is held
+   across opening and closing so that an inode is never read in
+   twice nor found while it is being torn down. */
+static struct hash open_inodes;
+static struct list closed_inodes;
+static size_t closed_cnt;               /* Length of closed_inodes. */
+static struct lock open_inodes_lock;
+
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct inode, elem)->sector);
+}
+
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode, elem)->sector
+          < hash_entry (b, struct inode, elem)->sector);
+}
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  hash_init (&open_inodes, inode_hash, inode_less, NULL);
+  list_init (&closed_inodes);
+  closed_cnt = 0;
+  lock_init (&open_inodes_lock);
+  lock_init (&delay_lock);
+  lock_init (&spare_lock);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data is all one hole, which reads as zeros; sectors
+   are allocated as it is written.  An inode no longer than
+   INLINE_DATA_SIZE bytes starts out keeping its data inline.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails. */
 
 //added4 3-1
 //add flag 
@@ -131,62 +1112,89 @@ inode_create (block_sector_t sector, off_t length, int is_dir)
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      size_t sectors = bytes_to_sectors (length);
       disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
+      if (length <= INLINE_DATA_SIZE)
+        disk_inode->magic = (inode_format == INODE_EXTENT
+                             ? INLINE_EXTENT_MAGIC : INLINE_MAGIC);
+      else
+        disk_inode->magic = (inode_format == INODE_EXTENT
+                             ? EXTENT_MAGIC : INODE_MAGIC);
       //set flag
       disk_inode->is_dir = is_dir;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
+      cache_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+      success = true; 
       free (disk_inode);
     }
   return success;
 }
 
+/* Returns the format of the inode stored in SECTOR. */
+enum inode_format
+inode_get_format (block_sector_t sector)
+{
+  unsigned magic;
+
+  cache_read (sector, &magic, offsetof (struct inode_disk, magic),
+              sizeof magic);
+  return (magic == EXTENT_MAGIC || magic == INLINE_EXTENT_MAGIC
+          ? INODE_EXTENT : INODE_INDEXED);
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
+  static struct inode key;      /* Protected by open_inodes_lock. */
+  struct hash_elem *e;
   struct inode *inode;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  lock_acquire (&open_inodes_lock);
+
+  /* Check whether this inode is already open, or was recently. */
+  key.sector = sector;
+  e = hash_find (&open_inodes, &key.elem);
+  if (e != NULL)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      inode = hash_entry (e, struct inode, elem);
+      if (inode->open_cnt++ == 0)
         {
-          inode_reopen (inode);
-          return inode; 
+          list_remove (&inode->closed_elem);
+          closed_cnt--;
         }
+      lock_release (&open_inodes_lock);
+      return inode;
     }
 
   /* Allocate memory. */
   inode = malloc (sizeof *inode);
   if (inode == NULL)
-    return NULL;
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
 
   /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
+  hash_insert (&open_inodes, &inode->elem);
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
+  memset (inode->ext_cache, 0, sizeof inode->ext_cache);
+  inode->ext_cache_next = 0;
+  memset (&inode->delayed, 0, sizeof inode->delayed);
+  rw_lock_init (&inode->ex_lock);
+  lock_init (&inode->lock);
+  cond_init (&inode->range_freed);
+  list_init (&inode->ranges);
+  rw_lock_init (&inode->dir_lock);
+  inode->length = read_disk_field (inode, DISK_OFS (length));
+  inode->magic = read_disk_field (inode, DISK_OFS (magic));
+  inode->is_dir = read_disk_field (inode, DISK_OFS (is_dir)) != 0;
+  cache_read (inode->sector, inode->direct, DISK_OFS (direct_map_table),
+              sizeof inode->direct);
+  lock_release (&open_inodes_lock);
   return inode;
 }
 
@@ -195,7 +1203,11 @@ struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    {
+      lock_acquire (&open_inodes_lock);
+      inode->open_cnt++;
+      lock_release (&open_inodes_lock);
+    }
   return inode;
 }
 
@@ -207,30 +1219,114 @@ inode_get_inumber (const struct inode *inode)
 }
 
 /* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If this was the last reference to INODE, keeps it among the
+   recently closed inodes, freeing the memory of the least recently
+   closed one if there are too many.
+   If INODE was also a removed inode, frees its blocks and memory. */
 void
 inode_close (struct inode *inode) 
 {
+  struct inode *removed = NULL;
+
   /* Ignore null pointer. */
   if (inode == NULL)
     return;
 
+  lock_acquire (&open_inodes_lock);
+
+  /* Before letting go of the last reference, allocate the delayed
+     sectors.  That does free map and disk I/O, so do it with
+     open_inodes_lock released, keeping INODE open meanwhile so
+     that it cannot be torn down.  Whoever opens it in the meantime
+     may delay more sectors, so check again afterward. */
+  while (inode->open_cnt == 1 && !inode->removed
+         && inode->delayed.cnt > 0)
+    {
+      lock_release (&open_inodes_lock);
+      rw_lock_write_acquire (&inode->ex_lock);
+      inode_allocate_delayed (inode);
+      rw_lock_write_release (&inode->ex_lock);
+      lock_acquire (&open_inodes_lock);
+    }
+
   /* Release resources if this was the last opener. */
   if (--inode->open_cnt == 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
+      /* Deallocate blocks if removed, below, once nobody can
+         find INODE any more. */
       if (inode->removed) 
         {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
+          hash_delete (&open_inodes, &inode->elem);
+          removed = inode;
+        }
+      else
+        {
+          list_push_back (&closed_inodes, &inode->closed_elem);
+          if (++closed_cnt > CLOSED_INODES_MAX)
+            {
+              struct inode *oldest = list_entry (list_pop_front (&closed_inodes),
+                                                 struct inode, closed_elem);
+              closed_cnt--;
+              hash_delete (&open_inodes, &oldest->elem);
+              free (oldest);
+            }
+        }
+    }
+
+  lock_release (&open_inodes_lock);
+
+  /* Deallocating does free map and disk I/O, so it is done with
+     open_inodes_lock released. */
+  if (removed != NULL)
+    {
+      struct inode_disk *disk_inode = inode_load (removed);
+
+      inode_discard_delayed (removed);
+      free_map_release (removed->sector, 1);
+      if (disk_inode != NULL)
+        free_inode_sectors (disk_inode);
+      free (disk_inode);
+      free (removed);
+    }
+}
+
+/* Allocates the delayed sectors of every open inode.  Called at
+   filesys_done(), before the free map is closed.  Like
+   inode_close(), does the allocating with open_inodes_lock
+   released, holding each inode open while it works on it. */
+void
+inode_allocate_all (void)
+{
+  for (;;)
+    {
+      struct hash_iterator i;
+      struct inode *inode = NULL;
+
+      lock_acquire (&open_inodes_lock);
+      hash_first (&i, &open_inodes);
+      while (hash_next (&i))
+        {
+          struct inode *cur = hash_entry (hash_cur (&i), struct inode, elem);
+
+          if (cur->delayed.cnt > 0 && !cur->removed)
+            {
+              inode = cur;
+              if (inode->open_cnt++ == 0)
+                {
+                  list_remove (&inode->closed_elem);
+                  closed_cnt--;
+                }
+              break;
+            }
         }
+      lock_release (&open_inodes_lock);
+      if (inode == NULL)
+        break;
 
-      free (inode); 
+      rw_lock_write_acquire (&inode->ex_lock);
+      inode_allocate_delayed (inode);
+      rw_lock_write_release (&inode->ex_lock);
+      inode_close (inode);
     }
 }
 
@@ -243,15 +1339,75 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Returns true if a write in place to INODE overlaps bytes
+   START...END-1.  INODE's lock must be held. */
+static bool
+range_busy (struct inode *inode, off_t start, off_t end)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&inode->ranges); e != list_end (&inode->ranges);
+       e = list_next (e))
+    {
+      struct write_range *r = list_entry (e, struct write_range, elem);
+      if (r->start < end && start < r->end)
+        return true;
+    }
+  return false;
+}
+
+/* Takes a shared hold on INODE's extension lock, then locks bytes
+   START...END-1 of INODE for writing in place, recording them in
+   RANGE, once no other write in place overlaps them. */
+static void
+lock_range (struct inode *inode, struct write_range *range,
+            off_t start, off_t end)
+{
+  rw_lock_read_acquire (&inode->ex_lock);
+  range->start = start;
+  range->end = end;
+  lock_acquire (&inode->lock);
+  while (range_busy (inode, start, end))
+    cond_wait (&inode->range_freed, &inode->lock);
+  list_push_back (&inode->ranges, &range->elem);
+  lock_release (&inode->lock);
+}
+
+/* Undoes lock_range() for RANGE in INODE. */
+static void
+unlock_range (struct inode *inode, struct write_range *range)
+{
+  lock_acquire (&inode->lock);
+  list_remove (&range->elem);
+  cond_broadcast (&inode->range_freed, &inode->lock);
+  lock_release (&inode->lock);
+  rw_lock_read_release (&inode->ex_lock);
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   Holes read as zeros without going to the cache or the disk. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
+  off_t run_end = offset;       /* End of the sectors loaded as a run. */
+
+  rw_lock_read_acquire (&inode->ex_lock);
+  if (is_inline (inode->magic))
+    {
+      if (size > inode_length (inode) - offset)
+        size = inode_length (inode) - offset;
+      if (size > 0)
+        {
+          cache_read (inode->sector, buffer, DISK_OFS (data) + offset, size);
+          bytes_read = size;
+        }
+      size = 0;
+    }
 
   while (size > 0) 
     {
@@ -269,6 +1425,28 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
+      /* If several whole sectors are left to read and they are
+         consecutive on disk, bring them into the cache with one
+         request instead of one at a time. */
+      if (sector_ofs == 0 && offset >= run_end)
+        {
+          size_t sec = offset / BLOCK_SECTOR_SIZE;
+          size_t cnt = (size < inode_left ? size : inode_left)
+                       / BLOCK_SECTOR_SIZE;
+          struct extent run;
+
+          /* Holes and delayed sectors are not mapped, so the run
+             stops short of them. */
+          if (cnt > 1 && inode_map (inode, sec, &run))
+            {
+              if (cnt > run.logical + run.length - sec)
+                cnt = run.logical + run.length - sec;
+              if (cnt > 1)
+                run_end = offset + BLOCK_SECTOR_SIZE
+                  * cache_read_run (run.physical + (sec - run.logical), cnt);
+            }
+        }
+
 //      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
 //        {
           /* Read full sector directly into caller's buffer. */
@@ -285,7 +1463,10 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 //                break;
 //            }
           //added in lab 4
-          cache_read(sector_idx,buffer+bytes_read,sector_ofs,chunk_size);
+          if (sector_idx == HOLE)
+            memset (buffer + bytes_read, 0, chunk_size);
+          else
+            cache_read(sector_idx,buffer+bytes_read,sector_ofs,chunk_size);
         
       
       /* Advance. */
@@ -294,15 +1475,42 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       bytes_read += chunk_size;
     }
   free (bounce);
+  rw_lock_read_release (&inode->ex_lock);
 
   return bytes_read;
 }
 
+/* Hints that INODE is being read sequentially and the caller has
+   consumed everything before OFFSET: queues the next
+   READ_AHEAD_SECTORS sectors not yet touched for background
+   read-ahead.  Delayed sectors are cached anyway, and holes have
+   nothing to read. */
+void
+inode_read_ahead (struct inode *inode, off_t offset)
+{
+  int i;
+
+  rw_lock_read_acquire (&inode->ex_lock);
+  offset = ROUND_UP (offset, BLOCK_SECTOR_SIZE);
+  for (i = 0; (i < READ_AHEAD_SECTORS && offset < inode_length (inode)
+               && !is_inline (inode->magic)); i++)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset);
+
+      if (sector != HOLE && !is_delayed (inode, offset / BLOCK_SECTOR_SIZE))
+        cache_read_ahead (sector);
+      offset += BLOCK_SECTOR_SIZE;
+    }
+  rw_lock_read_release (&inode->ex_lock);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk is full or an error occurs.
+   Holes the write reaches are given sectors, delayed ones if
+   possible; a write past end of file extends the inode, leaving
+   a hole over any gap.  An inline inode is written in place until
+   it would grow past INLINE_DATA_SIZE bytes. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset) 
@@ -310,25 +1518,70 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
   uint8_t *bounce = NULL;
+  size_t end = bytes_to_sectors (offset + size);
+  size_t fresh_end = 0;         /* End of the holes last filled. */
+  struct write_range range;
+  bool exclusive;
 
   if (inode->deny_write_cnt)
     return 0;
 
+  /* Extending the file changes its length and map, so that takes
+     the inode to itself.  Other writes lock only the bytes they
+     write, until they find a hole.  The length never shrinks, so
+     a write within it stays within it. */
+  exclusive = offset + size > inode_length (inode);
+  if (exclusive)
+    rw_lock_write_acquire (&inode->ex_lock);
+  else
+    lock_range (inode, &range, offset, offset + size);
+
+  if (is_inline (inode->magic))
+    {
+      if (offset + size <= INLINE_DATA_SIZE)
+        {
+          if (size > 0)
+            cache_write (inode->sector, buffer, DISK_OFS (data) + offset,
+                         size);
+          bytes_written = size;
+          offset += size;
+          size = 0;
+        }
+      else if (!inode_promote (inode))
+        size = 0;
+    }
+
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t sec = offset / BLOCK_SECTOR_SIZE;
+      block_sector_t sector_idx = file_sector (inode, sec);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
       int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+      int chunk_size = size < sector_left ? size : sector_left;
+
+      /* Fill this hole along with the ones right after it that the
+         write covers, so they can be allocated as one run. */
+      if (sector_idx == HOLE && !exclusive)
+        {
+          unlock_range (inode, &range);
+          rw_lock_write_acquire (&inode->ex_lock);
+          exclusive = true;
+          continue;
+        }
+      if (sector_idx == HOLE)
+        {
+          size_t cnt = 1;
+
+          while (sec + cnt < end && file_sector (inode, sec + cnt) == HOLE)
+            cnt++;
+          fresh_end = sec + fill_holes (inode, sec, cnt);
+          if (fresh_end == sec)
+            break;
+          sector_idx = file_sector (inode, sec);
+        }
 /*
       if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
@@ -353,7 +1606,11 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
           else
             memset (bounce, 0, BLOCK_SECTOR_SIZE);
           memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-       */ cache_write(sector_idx,buffer+bytes_written, sector_ofs,chunk_size);
+       */
+      /* A hole just filled holds garbage on disk. */
+      if (sec < fresh_end && chunk_size < BLOCK_SECTOR_SIZE)
+        cache_write (sector_idx, zeros, 0, BLOCK_SECTOR_SIZE);
+      cache_write(sector_idx,buffer+bytes_written, sector_ofs,chunk_size);
         
 
       /* Advance. */
@@ -363,6 +1620,19 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     }
    free (bounce);
 
+  if (exclusive)
+    {
+      if (offset > inode->length)
+        {
+          inode->length = offset;
+          cache_write (inode->sector, &inode->length,
+                       DISK_OFS (length), sizeof inode->length);
+        }
+      rw_lock_write_release (&inode->ex_lock);
+    }
+  else
+    unlock_range (inode, &range);
+
   return bytes_written;
 }
 
@@ -386,135 +1656,101 @@ inode_allow_write (struct inode *inode)
   inode->deny_write_cnt--;
 }
 
-/* Returns the length, in bytes, of INODE's data. */
-off_t
-inode_length (const struct inode *inode)
+/* Returns the number of extents INODE's data is stored in: runs
+   of file sectors in consecutive disk sectors.  Delayed sectors
+   count as one run; holes and inline data are in none. */
+size_t
+inode_extent_count (struct inode *inode)
 {
-  return inode->data.length;
+  size_t sec, end = bytes_to_sectors (inode_length (inode));
+  size_t cnt = 0;
+  block_sector_t next = NO_SECTOR;
+
+  rw_lock_read_acquire (&inode->ex_lock);
+  for (sec = 0; sec < end && !is_inline (inode->magic); sec++)
+    {
+      block_sector_t sector = byte_to_sector (inode, sec * BLOCK_SECTOR_SIZE);
+      if (sector == HOLE)
+        {
+          next = NO_SECTOR;
+          continue;
+        }
+      if (sector != next)
+        cnt++;
+      next = sector + 1;
+    }
+  rw_lock_read_release (&inode->ex_lock);
+  return cnt;
 }
 
-//added4 3-6
-//For system call isdir 
-//return true when inode is dir, otherwise return false
-bool is_directory(const struct inode *inode)
+/* Returns the number of disk sectors INODE's data takes up, index
+   blocks included but not the inode itself.  Holes take up none;
+   delayed sectors count, since free space is reserved for them. */
+size_t
+inode_allocated_sectors (struct inode *inode)
 {
-  struct inode_disk inode_disk = inode->data;
-  if(inode->removed)
-    return false;
+  size_t cnt;
+  size_t i;
 
-//  if(!get_disk_inode(inode,&inode_disk))
-//    return false;
+  rw_lock_read_acquire (&inode->ex_lock);
+  cnt = inode->delayed.cnt;
+  if (is_inline (inode->magic))
+    cnt = 0;
+  else if (inode->magic == EXTENT_MAGIC)
+    {
+      size_t extent_cnt = read_disk_field (inode, DISK_OFS (extent_cnt));
 
-  return inode_disk.is_dir;
+      for (i = 0; i < extent_cnt; i++)
+        {
+          struct extent e;
+          extent_fetch (inode, i, &e);
+          cnt += e.length;
+        }
+      if (read_disk_field (inode, DISK_OFS (overflow_sec)) != NO_SECTOR)
+        cnt++;
+    }
+  else
+    {
+      for (i = 0; i < DIRECT_BLOCK_ENTRIES; i++)
+        if (read_disk_field (inode, DISK_OFS (direct_map_table)
+                                    + i * sizeof (block_sector_t))
+            != NO_SECTOR)
+          cnt++;
+      cnt += count_table (read_disk_field (inode,
+                                           DISK_OFS (indirect_block_sec)), 1);
+      cnt += count_table (read_disk_field (inode,
+                                           DISK_OFS (double_indirect_block_sec)),
+                          2);
+    }
+  rw_lock_read_release (&inode->ex_lock);
+  return cnt;
 }
 
-//added4
-//getting disk inode from inode
-/*static void 
-get_disk_inode(const struct inode *inode, struct inode_disk *inode_disk)
+/* Returns the lock that directory code uses to keep the entries
+   of INODE, a directory, consistent while it works on them.  It is
+   separate from the lock inode_read_at() and inode_write_at() take
+   internally, so the directory code can call them while holding
+   it. */
+struct rw_lock *
+inode_dir_lock (struct inode *inode)
 {
-  //using cache read
-  filesys_cache_read(inode->sector, inode_disk, 0, sizeof(struct inode_disk));
+  return &inode->dir_lock;
 }
 
-static void
-set_location(off_t pos, struct sector_location *loc){
-
-  //block offset
-  off_t pos_sec = pos / BLOCK_SECTOR_SIZE;
-
-  //boundary 
-  loc->direct = ERR;
-  int direct = DIRECT_BLOCK_ENTRIES;
-  int indirect = INDIRECT_BLOCK_ENTRIES;
-  int double_in = indirect * indirect;
-  indirect += direct;
-  double_in += indirect; 
-
-  //direct
-  if(pos_sec < direct){
-     loc->direct = DIRECT;
-     loc->index1 = pos_sec;
-  }
-  //indirect
-  else if(pos_sec < indirect){
-     loc->direct = INDIRECT;
-     loc->index1 = pos_sec-direct;
-  }
-  //double indirect
-  else if(pos_sec < double_in){
-     loc->direct = DOUBLE;
-     loc->index1 = (pos_sec - indirect) / INDIRECT_BLOCK_ENTRIES;
-     loc->index2 = pos_sec % INDIRECT_BLOCK_ENTRIES;
-  }
-  //wrong offset
-  else
-    loc->direct = ERROR;
+/* Returns the length, in bytes, of INODE's data. */
+off_t
+inode_length (const struct inode *inode)
+{
+  return inode->length;
 }
 
-//convert index to byte offset
-static inline off_t 
-map_offset (int index){
+//added4 3-6
+//For system call isdir 
+//return true when inode is dir, otherwise return false
+bool is_directory(const struct inode *inode)
+{
+  if(inode->removed)
+    return false;
 
-  return index * sizeof(block_sector_t);   
+  return inode->is_dir;
 }
-
-//write sector  
-static bool
-write_sector(struct inode_disk  *inode_disk,
-                block_sector_t sector,
-                struct sector_location loc){
-
-   struct inode_indirect_blcok block1, block2;
-   bool dirty =false;
-   block_sector_t *indirect_sec = &inode_disk->indirect_block_sec;
-
-   switch(loc.direct){
-   //direct 
-   case DIRECT:
-     inode_disk-> direct_map_table[loc.index1] = sector;
-     return true;
-   //indirect
-   case INDIRECT:
-     
-    if(*indirect_sector == (block_sector_t) -1){
-       if(!free_map_allocate(1,table_sector))
-         return false;
-       memset(&block2, -1, sizeof(struct inode_indirect_block));
-    }
-    else
-      filesys_cache_read(*table_Sector, block2, 0, 
-                         sizeof(struct inode_indirect_block));
-   
-    if(block2.map_table[loc.index1] == (block_sector_t) -1)
-      block2.map_table[loc.index1] = new_secotr;
-    if(dirty && 
-       !filesys_cache_write(inode_disk->double_indirect_block_sec,
-                                     &block1, 0,sizeof(struct inode_indirect_block))
-      return false;
-
-    return true;
-   
-   case DOUBLE:
-     table_sector = &inode_disk->doube_indirect_block_sec;
-     
-     if(*table_sector == (block_sector_t) -1){
-       if(!free_map_allocate(1,table_sector))
-          return false;
-       memset(&block1, -1, sizeof(struct inode_indirect_block));
-     }
-     else
-       filesys_cache_read(*table_sector, &block1, 0, 
-                          sizeof(struct inode_indirect_block));
-    
-     table_sector = &block1.map_table[loc.index2];
-
-     if(*table_sector == (block_sector_t) -1)
-        first_dirty = true;
-   
-   default:
-     return false; 
-  }
-}
-*/
-
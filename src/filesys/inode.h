@@ -6,19 +6,35 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct rw_lock;
+
+/* How an inode maps file data to disk sectors. */
+enum inode_format
+  {
+    INODE_INDEXED,              /* Direct, indirect, double indirect. */
+    INODE_EXTENT                /* List of runs of consecutive sectors. */
+  };
+
+extern enum inode_format inode_format;
 
 void inode_init (void);
+enum inode_format inode_get_format (block_sector_t);
 bool inode_create (block_sector_t, off_t, int);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+void inode_allocate_all (void);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_read_ahead (struct inode *, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+struct rw_lock *inode_dir_lock (struct inode *);
+size_t inode_extent_count (struct inode *);
+size_t inode_allocated_sectors (struct inode *);
 bool is_directory(const struct inode *inode);
 
 #endif /* filesys/inode.h */
@@ -23,11 +23,20 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A second, smaller array summarizes the first, with one bit per
+   element of BITS that is set when all of that element's bits are.
+   Searching for false bits jumps over any run of full elements
+   with it.  The summary is kept up to date by every function that
+   changes bits, just after changing them, in a way that keeps
+   bitmap_mark(), bitmap_reset() and bitmap_flip() atomic: see
+   update_summary(). */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *full;    /* One bit per element of BITS, set if full. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +77,53 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the number of bytes required for the summary of a
+   bitmap of BIT_CNT bits. */
+static inline size_t
+summary_byte_cnt (size_t bit_cnt)
+{
+  return byte_cnt (elem_cnt (bit_cnt));
+}
+
+/* Brings the summary bit for element IDX of B's bits up to date.
+   Bits of the last element past the end of B count as set.
+   A summary word covers ELEM_BITS elements, so other threads may
+   be updating it at the same time for other elements, or for this
+   one.  The summary bit is therefore changed with a single OR or
+   AND instruction, like the bits themselves in bitmap_mark(), and
+   then recomputed if element IDX changed meanwhile, so that
+   whichever thread finishes last leaves it right. */
+static inline void
+update_summary (struct bitmap *b, size_t idx) 
+{
+  const volatile elem_type *bits = &b->bits[idx];
+  elem_type *full = &b->full[elem_idx (idx)];
+  elem_type mask = bit_mask (idx);
+  elem_type word, past_end;
+
+  past_end = idx == elem_cnt (b->bit_cnt) - 1 ? ~last_mask (b) : 0;
+  do
+    {
+      word = *bits;
+      if ((word | past_end) == (elem_type) -1)
+        asm volatile ("orl %1, %0" : "=m" (*full) : "r" (mask) : "cc");
+      else
+        asm volatile ("andl %1, %0" : "=m" (*full) : "r" (~mask) : "cc");
+    }
+  while (*bits != word);
+}
+
+/* Returns the number of bits set in WORD. */
+static inline size_t
+count_ones (elem_type word) 
+{
+  size_t cnt = 0;
+
+  for (; word != 0; word &= word - 1)
+    cnt++;
+  return cnt;
+}
 
 /* Creation and destruction. */
 
@@ -83,11 +139,14 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
-      if (b->bits != NULL || bit_cnt == 0)
+      b->full = malloc (summary_byte_cnt (bit_cnt));
+      if ((b->bits != NULL && b->full != NULL) || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
           return b;
         }
+      free (b->bits);
+      free (b->full);
       free (b);
     }
   return NULL;
@@ -105,6 +164,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->full = b->bits + elem_cnt (bit_cnt);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +174,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + byte_cnt (bit_cnt)
+         + summary_byte_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -126,6 +187,7 @@ bitmap_destroy (struct bitmap *b)
   if (b != NULL) 
     {
       free (b->bits);
+      free (b->full);
       free (b);
     }
 }
@@ -164,6 +226,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -177,6 +240,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -192,6 +256,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -203,6 +268,57 @@ bitmap_test (const struct bitmap *b, size_t idx)
   return (b->bits[elem_idx (idx)] & bit_mask (idx)) != 0;
 }
 
+/* Returns the index of the first bit in B at or after START and
+   before END, which must not exceed the size of B, that is set to
+   VALUE, or END if there is none.  Looks at a whole element at a
+   time, and when looking for false bits jumps straight to the next
+   element that is not full by finding the first clear bit of the
+   summary. */
+static size_t
+next_bit (const struct bitmap *b, size_t start, bool value, size_t end) 
+{
+  size_t elem_total = elem_cnt (end);
+  size_t full_total = elem_cnt (elem_total);
+  size_t idx = elem_idx (start);
+  elem_type word;
+  size_t bit;
+
+  ASSERT (end <= b->bit_cnt);
+  if (start >= end)
+    return end;
+
+  /* Flip the element so that the bits we want are ones, and drop
+     those below START. */
+  word = value ? b->bits[idx] : ~b->bits[idx];
+  word &= (elem_type) -1 << (start % ELEM_BITS);
+  while (word == 0)
+    {
+      if (++idx >= elem_total)
+        return end;
+      if (!value)
+        {
+          /* Summary bits past the last element may hold
+             anything; the bounds checks below catch them. */
+          size_t full_idx = elem_idx (idx);
+          elem_type not_full = (~b->full[full_idx]
+                                & ((elem_type) -1 << (idx % ELEM_BITS)));
+          while (not_full == 0)
+            {
+              if (++full_idx >= full_total)
+                return end;
+              not_full = ~b->full[full_idx];
+            }
+          idx = full_idx * ELEM_BITS + __builtin_ctzl (not_full);
+          if (idx >= elem_total)
+            return end;
+        }
+      word = value ? b->bits[idx] : ~b->bits[idx];
+    }
+
+  bit = idx * ELEM_BITS + __builtin_ctzl (word);
+  return bit < end ? bit : end;
+}
+
 /* Setting and testing multiple bits. */
 
 /* Sets all bits in B to VALUE. */
@@ -214,18 +330,26 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Whole elements in the middle are set at once. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  for (; start < end && start % ELEM_BITS != 0; start++)
+    bitmap_set (b, start, value);
+  for (; start + ELEM_BITS <= end; start += ELEM_BITS)
+    {
+      b->bits[elem_idx (start)] = value ? (elem_type) -1 : 0;
+      update_summary (b, elem_idx (start));
+    }
+  for (; start < end; start++)
+    bitmap_set (b, start, value);
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -240,9 +364,18 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  for (i = start; i < start + cnt; )
+    {
+      size_t ofs = i % ELEM_BITS;
+      size_t n = ELEM_BITS - ofs < start + cnt - i ? ELEM_BITS - ofs
+                                                   : start + cnt - i;
+      elem_type word = b->bits[elem_idx (i)] >> ofs;
+
+      if (n < ELEM_BITS)
+        word &= ((elem_type) 1 << n) - 1;
+      value_cnt += value ? count_ones (word) : n - count_ones (word);
+      i += n;
+    }
   return value_cnt;
 }
 
@@ -257,10 +390,8 @@ bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  i = next_bit (b, start, value, start + cnt);
+  return i < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -299,13 +430,47 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt == 0)
+    return start;
+  return bitmap_scan_range (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B that are all set to VALUE and that starts
+   at or after START and before END.  The group itself may extend
+   past END.
+   If there is no such group, returns BITMAP_ERROR.
+   Each run of VALUE bits is measured a word at a time, and only
+   as far as CNT bits, so the work done is bounded by END - START
+   + CNT bits rather than by the size of B. */
+size_t
+bitmap_scan_range (const struct bitmap *b, size_t start, size_t end,
+                   size_t cnt, bool value) 
+{
+  ASSERT (b != NULL);
+  ASSERT (start <= b->bit_cnt);
+
+  if (cnt <= b->bit_cnt && start < end) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      if (last > end - 1)
+        last = end - 1;
+      if (cnt == 0)
+        return i <= last ? i : BITMAP_ERROR;
+      while (i <= last)
+        {
+          size_t run_end;
+
+          i = next_bit (b, i, value, last + 1);
+          if (i > last)
+            break;
+          run_end = next_bit (b, i, !value, i + cnt);
+          if (run_end - i >= cnt)
+            return i;
+          i = run_end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -345,8 +510,12 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      size_t i;
+
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      for (i = 0; i < elem_cnt (b->bit_cnt); i++)
+        update_summary (b, i);
     }
   return success;
 }
@@ -359,6 +528,31 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to FILE, where bitmap_write() would put it, as whole elements.
+   Returns the number of bytes written if successful, -1
+   otherwise. */
+off_t
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t size;
+
+  ASSERT (b != NULL);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return 0;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  size = (last - first + 1) * sizeof (elem_type);
+  if (file_write_at (file, b->bits + first, size,
+                     first * sizeof (elem_type)) != size)
+    return -1;
+  return size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -182,3 +182,9 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+diskusage (int fd) 
+{
+  return syscall1 (SYS_DISKUSAGE, fd);
+}
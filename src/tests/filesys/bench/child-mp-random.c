@@ -0,0 +1,48 @@
+/* Child process for the mp-random benchmarks.
+   Reads randomly chosen blocks of the shared file and checks
+   that each one holds its block number.  With several of these
+   running at once, the disk sees a stream of scattered requests
+   for the scheduler to order. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/filesys/bench/mp-random.h"
+
+const char *test_name = "child-mp-random";
+
+static char block[BLOCK_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+  int fd;
+  size_t i, j;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (child_idx);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < READ_CNT; i++) 
+    {
+      size_t ofs = random_ulong () % BLOCK_CNT;
+
+      seek (fd, ofs * BLOCK_SIZE);
+      CHECK (read (fd, block, BLOCK_SIZE) == BLOCK_SIZE,
+             "read \"%s\"", file_name);
+      for (j = 0; j < BLOCK_SIZE; j++)
+        if (block[j] != (char) ofs)
+          fail ("byte %zu of block %zu is %d, expected %d",
+                j, ofs, block[j], (char) ofs);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,7 @@
+/* Replays the lg-random workload with the buffer cache using the
+   clock eviction policy.  Compare the "Buffer cache" line in the
+   kernel statistics against the other lg-random-* benchmark. */
+
+#define BLOCK_SIZE 512
+#define TEST_SIZE (512 * 150)
+#include "tests/filesys/base/random.inc"
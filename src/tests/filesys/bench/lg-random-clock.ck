@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-random-clock) begin
+(lg-random-clock) create "bazzle"
+(lg-random-clock) open "bazzle"
+(lg-random-clock) write "bazzle" in random order
+(lg-random-clock) read "bazzle" in random order
+(lg-random-clock) close "bazzle"
+(lg-random-clock) end
+EOF
+pass (grep (/^Buffer cache/, read_text_file ("$test.output")));
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-random-fifo) begin
+(lg-random-fifo) create "bazzle"
+(lg-random-fifo) open "bazzle"
+(lg-random-fifo) write "bazzle" in random order
+(lg-random-fifo) read "bazzle" in random order
+(lg-random-fifo) close "bazzle"
+(lg-random-fifo) end
+EOF
+pass (grep (/^Buffer cache/, read_text_file ("$test.output")));
@@ -0,0 +1,8 @@
+/* Writes a large file and reads it back in page-sized chunks on a
+   file system formatted with extent lists, so that each read can
+   map and fetch whole runs of sectors.  Compare the file system
+   device lines in the kernel statistics against lg-seq-indexed. */
+
+#define TEST_SIZE (512 * 300)
+#define CHUNK_SIZE 4096
+#include "tests/filesys/bench/seq-chunk.inc"
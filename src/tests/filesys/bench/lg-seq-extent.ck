@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-seq-extent) begin
+(lg-seq-extent) create "noodle"
+(lg-seq-extent) open "noodle"
+(lg-seq-extent) write "noodle" in 4096-byte chunks
+(lg-seq-extent) close "noodle"
+(lg-seq-extent) open "noodle"
+(lg-seq-extent) read "noodle" in 4096-byte chunks
+(lg-seq-extent) close "noodle"
+(lg-seq-extent) end
+EOF
+pass (grep (/^\S+ \(filesys\):/, read_text_file ("$test.output")));
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-seq-indexed) begin
+(lg-seq-indexed) create "noodle"
+(lg-seq-indexed) open "noodle"
+(lg-seq-indexed) write "noodle" in 4096-byte chunks
+(lg-seq-indexed) close "noodle"
+(lg-seq-indexed) open "noodle"
+(lg-seq-indexed) read "noodle" in 4096-byte chunks
+(lg-seq-indexed) close "noodle"
+(lg-seq-indexed) end
+EOF
+pass (grep (/^\S+ \(filesys\):/, read_text_file ("$test.output")));
@@ -0,0 +1,6 @@
+/* Runs 4 processes reading random blocks of one file at once,
+   dispatching disk requests with the C-LOOK elevator, which
+   sorts and merges them.  Compare the channel and timer lines in
+   the kernel statistics against mp-random-fifo. */
+
+#include "tests/filesys/bench/mp-random.inc"
@@ -0,0 +1,6 @@
+/* Runs 4 processes reading random blocks of one file at once,
+   dispatching disk requests first-come, first-served.  Compare
+   the channel and timer lines in the kernel statistics against
+   mp-random-clook. */
+
+#include "tests/filesys/bench/mp-random.inc"
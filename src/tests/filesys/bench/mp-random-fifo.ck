@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mp-random-fifo) begin
+(mp-random-fifo) create "data"
+(mp-random-fifo) open "data"
+(mp-random-fifo) write "data"
+(mp-random-fifo) close "data"
+(mp-random-fifo) exec child 1 of 4: "child-mp-random 0"
+(mp-random-fifo) exec child 2 of 4: "child-mp-random 1"
+(mp-random-fifo) exec child 3 of 4: "child-mp-random 2"
+(mp-random-fifo) exec child 4 of 4: "child-mp-random 3"
+(mp-random-fifo) wait for child 1 of 4 returned 0 (expected 0)
+(mp-random-fifo) wait for child 2 of 4 returned 1 (expected 1)
+(mp-random-fifo) wait for child 3 of 4 returned 2 (expected 2)
+(mp-random-fifo) wait for child 4 of 4 returned 3 (expected 3)
+(mp-random-fifo) end
+EOF
+pass (grep (/^(Timer:|ide\d )/, read_text_file ("$test.output")));
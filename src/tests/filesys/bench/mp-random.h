@@ -0,0 +1,13 @@
+#ifndef TESTS_FILESYS_BENCH_MP_RANDOM_H
+#define TESTS_FILESYS_BENCH_MP_RANDOM_H
+
+/* The shared file is BLOCK_CNT blocks of BLOCK_SIZE bytes, each
+   filled with its own block number, so that children can check
+   what they read without keeping a copy. */
+#define BLOCK_SIZE 512
+#define BLOCK_CNT 256
+#define CHILD_CNT 4
+#define READ_CNT 200
+static const char file_name[] = "data";
+
+#endif /* tests/filesys/bench/mp-random.h */
@@ -0,0 +1,44 @@
+/* Child process for syn-read-lg.
+   Reads the whole of a large file created by our parent, in
+   chunks that straddle sector boundaries, while other children
+   read it too and the parent overwrites it with the same data,
+   and makes sure the contents are what they should be. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read-lg.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-syn-read-lg";
+
+static char buf1[BUF_SIZE];
+static char buf2[READ_SIZE];
+
+int
+main (int argc, const char *argv[]) 
+{
+  int child_idx;
+  int fd;
+  size_t ofs;
+
+  quiet = true;
+  
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (buf1, sizeof buf1);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (ofs = 0; ofs < sizeof buf1; ofs += READ_SIZE)
+    {
+      size_t size = sizeof buf1 - ofs < READ_SIZE ? sizeof buf1 - ofs : READ_SIZE;
+      CHECK (read (fd, buf2, size) == (int) size,
+             "read %zu bytes at offset %zu in \"%s\"", size, ofs, file_name);
+      compare_bytes (buf2, buf1 + ofs, size, ofs, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,37 @@
+/* Creates and removes many short-lived files in one directory,
+   then checks that the directory is empty and that it never grew
+   out of its inode sector, because each removal left space the
+   next file's entry could reuse. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  char file_name[32];
+  int fd, i;
+
+  CHECK (mkdir ("/t"), "mkdir \"/t\"");
+
+  msg ("creating and removing /t/tmp0 through /t/tmp%d", FILE_CNT - 1);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "/t/tmp%d", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+      if (!remove (file_name))
+        fail ("remove \"%s\" failed", file_name);
+    }
+
+  CHECK ((fd = open ("/t")) > 1, "open \"/t\"");
+  CHECK (!readdir (fd, name), "verify \"/t\" is empty");
+  CHECK (diskusage (fd) == 0, "diskusage \"/t\" is 0");
+  msg ("close \"/t\"");
+  close (fd);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-churn) begin
+(dir-churn) mkdir "/t"
+(dir-churn) creating and removing /t/tmp0 through /t/tmp199
+(dir-churn) open "/t"
+(dir-churn) verify "/t" is empty
+(dir-churn) diskusage "/t" is 0
+(dir-churn) close "/t"
+(dir-churn) end
+EOF
+pass;
@@ -0,0 +1,58 @@
+/* Removes entries from a directory while readdir is partway
+   through it, and checks that readdir neither returns a removed
+   name nor loses its place when a new entry reuses the space. */
+
+#include <syscall.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Reads the next name from FD and checks that it is EXPECTED. */
+static void
+expect_next (int fd, const char *expected) 
+{
+  char name[READDIR_MAX_LEN + 1];
+
+  if (!readdir (fd, name))
+    fail ("readdir returned nothing, expected \"%s\"", expected);
+  if (strcmp (name, expected))
+    fail ("readdir returned \"%s\", expected \"%s\"", name, expected);
+  msg ("readdir returned \"%s\"", name);
+}
+
+void
+test_main (void) 
+{
+  char name[READDIR_MAX_LEN + 1];
+  int fd1, fd2;
+
+  CHECK (mkdir ("/d"), "mkdir \"/d\"");
+  CHECK (create ("/d/a", 0), "create \"/d/a\"");
+  CHECK (create ("/d/b", 0), "create \"/d/b\"");
+  CHECK (create ("/d/c", 0), "create \"/d/c\"");
+  CHECK (create ("/d/d", 0), "create \"/d/d\"");
+
+  CHECK ((fd1 = open ("/d")) > 1, "open \"/d\"");
+  CHECK ((fd2 = open ("/d")) > 1, "open \"/d\" again");
+  expect_next (fd1, "a");
+  expect_next (fd2, "a");
+  expect_next (fd2, "b");
+
+  /* Both are now just before "c".  Remove it. */
+  CHECK (remove ("/d/c"), "remove \"/d/c\"");
+  expect_next (fd1, "b");
+  expect_next (fd1, "d");
+
+  /* A new name longer than "b" takes over the space of "b" and
+     "c", so fd2's place is now in the middle of it. */
+  CHECK (remove ("/d/b"), "remove \"/d/b\"");
+  CHECK (create ("/d/eeeeeeee", 0), "create \"/d/eeeeeeee\"");
+  expect_next (fd2, "d");
+
+  CHECK (!readdir (fd1, name), "readdir \"/d\" reaches the end");
+  CHECK (!readdir (fd2, name), "readdir \"/d\" again reaches the end");
+  msg ("close \"/d\"");
+  close (fd1);
+  msg ("close \"/d\" again");
+  close (fd2);
+}
@@ -0,0 +1,29 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-readdir-rm) begin
+(dir-readdir-rm) mkdir "/d"
+(dir-readdir-rm) create "/d/a"
+(dir-readdir-rm) create "/d/b"
+(dir-readdir-rm) create "/d/c"
+(dir-readdir-rm) create "/d/d"
+(dir-readdir-rm) open "/d"
+(dir-readdir-rm) open "/d" again
+(dir-readdir-rm) readdir returned "a"
+(dir-readdir-rm) readdir returned "a"
+(dir-readdir-rm) readdir returned "b"
+(dir-readdir-rm) remove "/d/c"
+(dir-readdir-rm) readdir returned "b"
+(dir-readdir-rm) readdir returned "d"
+(dir-readdir-rm) remove "/d/b"
+(dir-readdir-rm) create "/d/eeeeeeee"
+(dir-readdir-rm) readdir returned "d"
+(dir-readdir-rm) readdir "/d" reaches the end
+(dir-readdir-rm) readdir "/d" again reaches the end
+(dir-readdir-rm) close "/d"
+(dir-readdir-rm) close "/d" again
+(dir-readdir-rm) end
+EOF
+pass;
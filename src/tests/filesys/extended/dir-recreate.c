@@ -0,0 +1,36 @@
+/* Looks up names before and after they are created and removed,
+   both as files and as directories, to check that lookups never
+   see a stale answer. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (open ("/a") == -1, "open \"/a\" (must return -1)");
+  CHECK (create ("/a", 0), "create \"/a\"");
+  CHECK ((fd = open ("/a")) > 1, "open \"/a\"");
+  close (fd);
+  CHECK (remove ("/a"), "remove \"/a\"");
+  CHECK (open ("/a") == -1, "open \"/a\" (must return -1)");
+
+  CHECK (mkdir ("/a"), "mkdir \"/a\"");
+  CHECK (open ("/a/b") == -1, "open \"/a/b\" (must return -1)");
+  CHECK (create ("/a/b", 0), "create \"/a/b\"");
+  CHECK ((fd = open ("/a/b")) > 1, "open \"/a/b\"");
+  close (fd);
+  CHECK (remove ("/a/b"), "remove \"/a/b\"");
+  CHECK (remove ("/a"), "rmdir \"/a\"");
+  CHECK (open ("/a/b") == -1, "open \"/a/b\" (must return -1)");
+
+  CHECK (mkdir ("/a"), "mkdir \"/a\"");
+  CHECK (open ("/a/b") == -1, "open \"/a/b\" (must return -1)");
+  CHECK (chdir ("/a"), "chdir \"/a\"");
+  CHECK (create ("b", 0), "create \"b\"");
+  CHECK ((fd = open ("/a/b")) > 1, "open \"/a/b\"");
+  close (fd);
+}
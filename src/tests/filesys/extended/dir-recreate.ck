@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-recreate) begin
+(dir-recreate) open "/a" (must return -1)
+(dir-recreate) create "/a"
+(dir-recreate) open "/a"
+(dir-recreate) remove "/a"
+(dir-recreate) open "/a" (must return -1)
+(dir-recreate) mkdir "/a"
+(dir-recreate) open "/a/b" (must return -1)
+(dir-recreate) create "/a/b"
+(dir-recreate) open "/a/b"
+(dir-recreate) remove "/a/b"
+(dir-recreate) rmdir "/a"
+(dir-recreate) open "/a/b" (must return -1)
+(dir-recreate) mkdir "/a"
+(dir-recreate) open "/a/b" (must return -1)
+(dir-recreate) chdir "/a"
+(dir-recreate) create "b"
+(dir-recreate) open "/a/b"
+(dir-recreate) end
+EOF
+pass;
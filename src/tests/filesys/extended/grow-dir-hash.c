@@ -0,0 +1,65 @@
+/* Creates enough files in one directory for it to be indexed,
+   removes every other one, and checks that lookups and readdir
+   still see exactly the files that are left. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 300
+
+void
+test_main (void) 
+{
+  static bool seen[FILE_CNT];
+  char name[READDIR_MAX_LEN + 1];
+  char file_name[32];
+  size_t i, found;
+  int fd;
+
+  CHECK (mkdir ("/x"), "mkdir \"/x\"");
+
+  msg ("creating /x/f0 through /x/f%d", FILE_CNT - 1);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "/x/f%zu", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+    }
+
+  msg ("removing the odd-numbered files");
+  for (i = 1; i < FILE_CNT; i += 2)
+    {
+      snprintf (file_name, sizeof file_name, "/x/f%zu", i);
+      if (!remove (file_name))
+        fail ("remove \"%s\" failed", file_name);
+    }
+
+  msg ("opening every file");
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (file_name, sizeof file_name, "/x/f%zu", i);
+      fd = open (file_name);
+      if ((fd > 1) != (i % 2 == 0))
+        fail ("open \"%s\" returned %d", file_name, fd);
+      if (fd > 1)
+        close (fd);
+    }
+
+  CHECK ((fd = open ("/x")) > 1, "open \"/x\"");
+  found = 0;
+  while (readdir (fd, name))
+    {
+      int n = atoi (name + 1);
+      if (name[0] != 'f' || n < 0 || n >= FILE_CNT || n % 2 != 0 || seen[n])
+        fail ("readdir returned unexpected \"%s\"", name);
+      seen[n] = true;
+      found++;
+    }
+  close (fd);
+  if (found != FILE_CNT / 2)
+    fail ("readdir found %zu files, expected %d", found, FILE_CNT / 2);
+  msg ("readdir found %zu files", found);
+}
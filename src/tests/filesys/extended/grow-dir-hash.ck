@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-dir-hash) begin
+(grow-dir-hash) mkdir "/x"
+(grow-dir-hash) creating /x/f0 through /x/f299
+(grow-dir-hash) removing the odd-numbered files
+(grow-dir-hash) opening every file
+(grow-dir-hash) open "/x"
+(grow-dir-hash) readdir found 150 files
+(grow-dir-hash) end
+EOF
+pass;
@@ -0,0 +1,33 @@
+/* Grows a file from 0 bytes to 2,000 bytes, 100 bytes at a time,
+   checking that it takes up no data sectors as long as it is small
+   enough to be kept in its inode. */
+
+#include <syscall.h>
+#include "tests/filesys/seq-test.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[2000];
+
+static size_t
+return_block_size (void) 
+{
+  return 100;
+}
+
+static void
+check_usage (int fd, long ofs) 
+{
+  int sectors = diskusage (fd);
+
+  if (ofs <= 400 && sectors != 0)
+    fail ("%ld-byte file takes up %d sectors", ofs, sectors);
+}
+
+void
+test_main (void) 
+{
+  seq_test ("testme",
+            buf, sizeof buf, 0,
+            return_block_size, check_usage);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-usage) begin
+(grow-sparse-usage) create "testfile"
+(grow-sparse-usage) open "testfile"
+(grow-sparse-usage) seek "testfile"
+(grow-sparse-usage) write "testfile"
+(grow-sparse-usage) diskusage "testfile"
+(grow-sparse-usage) close "testfile"
+(grow-sparse-usage) open "testfile"
+(grow-sparse-usage) diskusage "testfile" after reopening
+(grow-sparse-usage) close "testfile"
+(grow-sparse-usage) open "testfile" for verification
+(grow-sparse-usage) verified contents of "testfile"
+(grow-sparse-usage) close "testfile"
+(grow-sparse-usage) end
+EOF
+pass;
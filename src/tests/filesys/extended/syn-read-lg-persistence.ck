@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"child-syn-read-lg" => "tests/filesys/extended/child-syn-read-lg",
+		"bigfile" => [random_bytes (64 * 1024)]});
+pass;
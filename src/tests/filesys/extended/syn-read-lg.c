@@ -0,0 +1,44 @@
+/* Writes a file large enough to need an indirect block, then
+   spawns subprocesses that all read it at once while we overwrite
+   it in place with the same data. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/extended/syn-read-lg.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[BUF_SIZE];
+
+#define CHILD_CNT 4
+
+void
+test_main (void) 
+{
+  pid_t children[CHILD_CNT];
+  size_t ofs;
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  random_bytes (buf, sizeof buf);
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf,
+         "write \"%s\"", file_name);
+
+  exec_children ("child-syn-read-lg", children, CHILD_CNT);
+
+  quiet = true;
+  seek (fd, 0);
+  for (ofs = 0; ofs < BUF_SIZE; ofs += WRITE_SIZE)
+    {
+      size_t size = BUF_SIZE - ofs < WRITE_SIZE ? BUF_SIZE - ofs : WRITE_SIZE;
+      CHECK (write (fd, buf + ofs, size) == (int) size,
+             "write %zu bytes at offset %zu in \"%s\"",
+             size, ofs, file_name);
+    }
+  quiet = false;
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  wait_children (children, CHILD_CNT);
+}
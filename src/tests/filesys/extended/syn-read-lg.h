@@ -0,0 +1,9 @@
+#ifndef TESTS_FILESYS_EXTENDED_SYN_READ_LG_H
+#define TESTS_FILESYS_EXTENDED_SYN_READ_LG_H
+
+#define BUF_SIZE (64 * 1024)
+#define READ_SIZE 1000
+#define WRITE_SIZE 1234
+static const char file_name[] = "bigfile";
+
+#endif /* tests/filesys/extended/syn-read-lg.h */
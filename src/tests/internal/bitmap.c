@@ -0,0 +1,146 @@
+/* Test program and microbenchmark for lib/kernel/bitmap.c.
+
+   Checks bitmap_scan(), bitmap_count() and bitmap_contains()
+   against straightforward bit-by-bit versions on random bitmaps,
+   then times bitmap_scan() looking for free bits in a mostly full
+   bitmap, the case the free map and the page allocator hit when
+   memory or the disk is nearly used up.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/test.h"
+
+/* Largest bitmap checked against the simple versions. */
+#define MAX_BITS 2048
+
+/* Size of the bitmap used for timing. */
+#define BENCH_BITS (64 * 1024)
+
+/* Number of scans timed. */
+#define BENCH_SCANS 200
+
+static size_t simple_scan (const struct bitmap *, size_t start, size_t cnt,
+                           bool value);
+static size_t simple_count (const struct bitmap *, size_t start, size_t cnt,
+                            bool value);
+static void fill_random (struct bitmap *, int percent);
+
+/* Test and time the bitmap implementation. */
+void
+test (void)
+{
+  struct bitmap *b;
+  int64_t start_time;
+  size_t bits;
+  int i;
+
+  printf ("testing random bitmaps:");
+  for (bits = 0; bits <= MAX_BITS; bits += 97)
+    {
+      int repeat;
+
+      printf (" %zu", bits);
+      b = bitmap_create (bits);
+      ASSERT (b != NULL);
+      for (repeat = 0; repeat < 10; repeat++)
+        {
+          fill_random (b, repeat * 10);
+          for (i = 0; i < 20; i++)
+            {
+              size_t start = random_ulong () % (bits + 1);
+              size_t cnt = random_ulong () % 40;
+              bool value = random_ulong () % 2;
+
+              ASSERT (bitmap_scan (b, start, cnt, value)
+                      == simple_scan (b, start, cnt, value));
+              if (start + cnt <= bits)
+                {
+                  size_t value_cnt = simple_count (b, start, cnt, value);
+                  ASSERT (bitmap_count (b, start, cnt, value) == value_cnt);
+                  ASSERT (bitmap_contains (b, start, cnt, value)
+                          == (value_cnt > 0));
+                }
+            }
+        }
+      bitmap_destroy (b);
+    }
+  printf (" done\n");
+
+  /* Mostly full, with the only free run near the end. */
+  b = bitmap_create (BENCH_BITS);
+  ASSERT (b != NULL);
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, BENCH_BITS - 100, 8, false);
+
+  printf ("timing %d scans of a %d-bit bitmap:", BENCH_SCANS, BENCH_BITS);
+  start_time = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (bitmap_scan (b, 0, 8, false) == BENCH_BITS - 100);
+  printf (" bitmap_scan %"PRId64" ticks,", timer_elapsed (start_time));
+  start_time = timer_ticks ();
+  for (i = 0; i < BENCH_SCANS; i++)
+    ASSERT (simple_scan (b, 0, 8, false) == BENCH_BITS - 100);
+  printf (" bit by bit %"PRId64" ticks\n", timer_elapsed (start_time));
+  bitmap_destroy (b);
+}
+
+/* Finds the first run of CNT bits set to VALUE in B at or after
+   START, testing one bit at a time from every starting point. */
+static size_t
+simple_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  if (cnt > bitmap_size (b))
+    return BITMAP_ERROR;
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Counts the bits set to VALUE among the CNT starting at START in
+   B, one at a time. */
+static size_t
+simple_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, value_cnt = 0;
+
+  for (i = start; i < start + cnt; i++)
+    if (bitmap_test (b, i) == value)
+      value_cnt++;
+  return value_cnt;
+}
+
+/* Sets about PERCENT percent of the bits in B, at random, and
+   clears the rest, sometimes overwriting a random stretch with
+   bitmap_set_multiple(). */
+static void
+fill_random (struct bitmap *b, int percent)
+{
+  size_t bits = bitmap_size (b);
+  size_t i;
+
+  for (i = 0; i < bits; i++)
+    bitmap_set (b, i, (int) (random_ulong () % 100) < percent);
+  if (bits > 0 && random_ulong () % 2)
+    {
+      size_t start = random_ulong () % bits;
+      size_t cnt = random_ulong () % (bits - start + 1);
+      bitmap_set_multiple (b, start, cnt, random_ulong () % 2);
+    }
+}
@@ -36,6 +36,8 @@
 #include "devices/ide.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#include "filesys/buffer_cache.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -242,11 +244,57 @@ parse_options (char **argv)
         shutdown_configure (SHUTDOWN_REBOOT);
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
-        format_filesys = true;
+        {
+          format_filesys = true;
+          if (value == NULL)
+            ;
+          else if (!strcmp (value, "indexed"))
+            inode_format = INODE_INDEXED;
+          else if (!strcmp (value, "extent"))
+            inode_format = INODE_EXTENT;
+          else
+            PANIC ("unknown inode format `%s'", value);
+        }
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-bc"))
+        {
+          cache_size = value != NULL ? atoi (value) : 0;
+          if (cache_size == 0)
+            PANIC ("buffer cache size must be at least 1 sector");
+        }
+      else if (!strcmp (name, "-wb"))
+        {
+          cache_flush_interval = value != NULL ? atoi (value) : 0;
+          if (cache_flush_interval <= 0)
+            PANIC ("write-behind interval must be at least 1 tick");
+        }
+      else if (!strcmp (name, "-wbr"))
+        {
+          cache_dirty_ratio = value != NULL ? atoi (value) : -1;
+          if (cache_dirty_ratio < 0 || cache_dirty_ratio > 100)
+            PANIC ("write-behind dirty ratio must be 0 to 100 percent");
+        }
+      else if (!strcmp (name, "-iosched"))
+        {
+          if (value != NULL && !strcmp (value, "fifo"))
+            ide_sched = IDE_SCHED_FIFO;
+          else if (value != NULL && !strcmp (value, "clook"))
+            ide_sched = IDE_SCHED_CLOOK;
+          else
+            PANIC ("unknown disk scheduler `%s'", value);
+        }
+      else if (!strcmp (name, "-bcp"))
+        {
+          if (value != NULL && !strcmp (value, "fifo"))
+            cache_policy = CACHE_FIFO;
+          else if (value != NULL && !strcmp (value, "clock"))
+            cache_policy = CACHE_CLOCK;
+          else
+            PANIC ("unknown buffer cache policy `%s'", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -315,6 +363,7 @@ run_actions (char **argv)
       {"rm", 2, fsutil_rm},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
+      {"extents", 2, fsutil_extents},
 #endif
       {NULL, 0, NULL},
     };
@@ -364,6 +413,7 @@ usage (void)
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
+          "  extents FILE       Print how many extents FILE is stored in.\n"
 #endif
           "\nOptions:\n"
           "  -h                 Print this help message and power off.\n"
@@ -371,8 +421,14 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -f=indexed|extent  ...choosing how inodes map file data.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -bc=N              Use a buffer cache of N sectors (default 64).\n"
+          "  -bcp=fifo|clock    Set buffer cache eviction policy.\n"
+          "  -wb=TICKS          Write dirty cache buffers back every TICKS.\n"
+          "  -wbr=PERCENT       ...or as soon as PERCENT of the cache is dirty.\n"
+          "  -iosched=clook|fifo Set disk request scheduling policy.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -41,6 +41,25 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock.
+   Any number of readers may hold it at once, or a single writer.
+   Waiting writers keep new readers out so they cannot starve. */
+struct rw_lock
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition can_read;  /* Signaled when readers may enter. */
+    struct condition can_write; /* Signaled when a writer may enter. */
+    int readers;                /* Number of readers holding the lock. */
+    int waiting_writers;        /* Number of writers waiting. */
+    bool writer;                /* Is a writer holding the lock? */
+  };
+
+void rw_lock_init (struct rw_lock *);
+void rw_lock_read_acquire (struct rw_lock *);
+void rw_lock_read_release (struct rw_lock *);
+void rw_lock_write_acquire (struct rw_lock *);
+void rw_lock_write_release (struct rw_lock *);
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
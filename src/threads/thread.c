@@ -11,6 +11,7 @@
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/ide.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -47,6 +48,7 @@ struct kernel_thread_frame
 
 /* Statistics. */
 static long long idle_ticks;    /* # of timer ticks spent idle. */
+static long long io_idle_ticks; /* # of idle ticks with disk I/O pending. */
 static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
 static long long user_ticks;    /* # of timer ticks in user programs. */
 
@@ -126,7 +128,11 @@ thread_tick (void)
 
   /* Update statistics. */
   if (t == idle_thread)
-    idle_ticks++;
+    {
+      idle_ticks++;
+      if (ide_busy ())
+        io_idle_ticks++;
+    }
 #ifdef USERPROG
   else if (t->pagedir != NULL)
     user_ticks++;
@@ -143,8 +149,9 @@ thread_tick (void)
 void
 thread_print_stats (void) 
 {
-  printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %lld idle ticks (%lld during disk I/O), "
+          "%lld kernel ticks, %lld user ticks\n",
+          idle_ticks, io_idle_ticks, kernel_ticks, user_ticks);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -41,6 +41,7 @@ bool mkdir(const char *dir);
 bool readdir(int fd, char *name);
 bool isdir(int fd);
 int inumber(int fd);
+int diskusage(int fd);
 
 //struct lock filesys_lock;
 
@@ -167,6 +168,11 @@ syscall_handler (struct intr_frame *f UNUSED)
    *eax=inumber(arg[0]);
    break;  
 
+  case SYS_DISKUSAGE:
+   get_argument(esp,arg,1);
+   *eax=diskusage(arg[0]);
+   break;
+
   default:
    exit(-1);
   }
@@ -262,9 +268,9 @@ int filesize(int fd){
    return file_length(f);
 }
 
+//file reads and writes lock the inode themselves
 int read(int fd, void *buffer, unsigned size){
    //printf("im'in read\n");
-   lock_acquire(&filesys_lock);
    if(fd==0){
       unsigned n = size;
       while(n){
@@ -272,36 +278,29 @@ int read(int fd, void *buffer, unsigned size){
         (char *)buffer++;
         n--;
       }
-      lock_release(&filesys_lock);
       return size;
    }
    
    struct file *f = process_get_file(fd);
    if(f == NULL){
-      lock_release(&filesys_lock);
       return -1;
    }
    size = file_read(f,buffer,size);
-   lock_release(&filesys_lock);
    return size;
 }
  
 int write(int fd, void *buffer, unsigned size){
 
-   lock_acquire(&filesys_lock);
    if(fd==1){
       putbuf(buffer,size);
-      lock_release(&filesys_lock);
       return size;
    }
    
    struct file *f = process_get_file(fd);
    if(!f){
-     lock_release(&filesys_lock);
      return 0;
    }
    size = file_write(f,buffer,size);
-   lock_release(&filesys_lock);
    //printf("write size: %d \n",size);
    return size;
 } 
@@ -360,11 +359,12 @@ mkdir(const char *dir){
 
   struct dir *dir_pre = parsing_path(dir,name);
   //allocate free map
-  //create directory with 16 entries
+  //create empty directory, entries are added as needed
   //add new direcotry
   bool success =(dir_pre !=NULL
-                 && free_map_allocate(1,&inode_sec)
-                 && dir_create(inode_sec,16)
+                 && free_map_allocate_near(
+                      inode_get_inumber(dir_get_inode(dir_pre)),1,&inode_sec)
+                 && dir_create(inode_sec)
                  && dir_add(dir_pre,name, inode_sec));
 
  //if fail to create directory, release free map
@@ -396,13 +396,17 @@ readdir(int fd, char *name){
  if(!inode || !is_directory(inode))
    return false;
  
- struct dir *dir = dir_open(inode);
+ //the fd's file position remembers where the last readdir stopped
+ struct dir *dir = dir_open(inode_reopen(inode));
  if(!dir)
    return false;
   
-  
+  dir_seek(dir, file_tell(f));
+  bool success = dir_readdir(dir,name);
+  file_seek(f, dir_tell(dir));
+  dir_close(dir);
 
-  return dir_readdir(dir,name);
+  return success;
 }
 
 //return ture if fd represents a directory
@@ -434,3 +438,17 @@ inumber(int fd){
     
   return inode_get_inumber(inode);  
 }
+
+//return number of disk sectors the file takes up, holes excluded
+int
+diskusage(int fd){
+
+  struct file *f = process_get_file(fd);
+  if(f==NULL)
+    exit(-1);
+  struct inode *inode =file_get_inode(f);
+  if(inode ==NULL)
+    exit(-1);
+
+  return inode_allocated_sectors(inode);
+}